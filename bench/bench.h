@@ -0,0 +1,33 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+
+#define BENCH_REPS 15
+
+bool bench_enabled(const char* group, const char* name);
+void bench_report(const char* group, const char* name, long ops, double* ns_per_op, int reps);
+
+// stops the compiler from dropping a result that is never read
+template<typename T> inline void bench_keep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+// fn does ops operations per call, it's called once to warm up and then timed BENCH_REPS times
+template<typename F> void bench(const char* group, const char* name, long ops, F fn) {
+    if (!bench_enabled(group, name)) return;
+    double ns_per_op[BENCH_REPS];
+    fn();
+    for (int rep = 0; rep < BENCH_REPS; rep++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        ns_per_op[rep] = std::chrono::duration<double, std::nano>(end - start).count() / ops;
+    }
+    bench_report(group, name, ops, ns_per_op, BENCH_REPS);
+}
+
+void bench_math();
+void bench_world();
+
+#endif
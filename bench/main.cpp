@@ -0,0 +1,46 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool csv = false;
+static const char* filter = NULL;
+
+bool bench_enabled(const char* group, const char* name) {
+    if (!filter) return true;
+    char full[128];
+    snprintf(full, sizeof(full), "%s/%s", group, name);
+    return strstr(full, filter) != NULL;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void bench_report(const char* group, const char* name, long ops, double* ns_per_op, int reps) {
+    qsort(ns_per_op, reps, sizeof(double), compare_doubles);
+    double median = reps % 2 ? ns_per_op[reps / 2] : (ns_per_op[reps / 2 - 1] + ns_per_op[reps / 2]) / 2;
+    if (csv) printf("%s,%s,%ld,%d,%.3f,%.3f,%.3f\n", group, name, ops, reps, median, ns_per_op[0], ns_per_op[reps - 1]);
+    else     printf("%-8s %-32s %14.2f %14.2f %14.2f\n", group, name, median, ns_per_op[0], ns_per_op[reps - 1]);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if      (strcmp(argv[i], "--csv") == 0) csv = true;
+        else if (argv[i][0] != '-')            filter = argv[i];
+        else {
+            printf("usage: %s [--csv] [filter]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (csv) printf("group,name,ops,reps,median_ns,min_ns,max_ns\n");
+    else     printf("%-8s %-32s %14s %14s %14s\n", "group", "name", "median ns/op", "min ns/op", "max ns/op");
+
+    bench_math();
+    bench_world();
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "bench.h"
+
+#include "types.h"
+#include "block_info.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#define NUM_INPUTS 64 // inputs cycle through this many values so nothing gets hoisted out of the loop
+#define BATCH_SIZE 1024
+
+static float random_float(float min, float max) {
+    return min + rand() / (float)RAND_MAX * (max - min);
+}
+
+static Vec3 random_vec3() {
+    return Vec3(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1));
+}
+
+// the kinds of matrices the editor actually builds
+static Mtx random_rigid() {
+    return Mtx::translate(random_vec3() * 10) * Mtx::quaternion(random_vec3(), random_float(-3, 3));
+}
+
+static Mtx random_diagonal() {
+    return Mtx::orthographic(-random_float(1, 4), random_float(1, 4), -random_float(1, 4), random_float(1, 4), .1f, 100);
+}
+
+static Mtx random_affine() {
+    return random_rigid() * Mtx::scale(random_float(.5f, 2), random_float(.5f, 2), random_float(.5f, 2));
+}
+
+static Mtx random_general() {
+    return Mtx::perspective(random_float(.5f, 1.5f), random_float(1, 2), .1f, 100) * random_rigid();
+}
+
+#define INVERSE_TOLERANCE 1e-4f
+
+// the specialized inverse has to be the one picked and has to agree with the general one, or the timing means nothing
+static void check_inverse(const char* name, const Mtx& mtx, int structure) {
+    if (mtx.structure() != structure) {
+        printf("%s: built with structure %d but tagged %d\n", name, structure, mtx.structure());
+        exit(1);
+    }
+    Mtx fast = mtx.inv(), general = mtx.inv_general();
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            float error = fabsf(fast[r][c] - general[r][c]);
+            if (error <= INVERSE_TOLERANCE * (1 + fabsf(general[r][c]))) continue;
+            printf("%s: inv() is off from inv_general() by %g at [%d][%d]\n", name, error, r, c);
+            exit(1);
+        }
+    }
+}
+
+template<typename F> static void bench_inverse(const char* name, int structure, F make) {
+    std::vector<Mtx> inputs;
+    for (int i = 0; i < NUM_INPUTS; i++) inputs.push_back(make());
+    if (bench_enabled("mtx", name)) {
+        for (const Mtx& mtx : inputs) check_inverse(name, mtx, structure);
+    }
+    bench("mtx", name, 1 << 20, [&]() {
+        for (int i = 0; i < 1 << 20; i++) bench_keep(inputs[i % NUM_INPUTS].inv());
+    });
+}
+
+static void bench_mtx() {
+    std::vector<Mtx> a, b;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        a.push_back(random_diagonal());
+        b.push_back(random_affine());
+    }
+    bench("mtx", "multiply", 1 << 20, [&]() {
+        for (int i = 0; i < 1 << 20; i++) bench_keep(a[i % NUM_INPUTS] * b[(i + 1) % NUM_INPUTS]);
+    });
+
+    bench_inverse("inverse rigid",    Mtx_Affine | Mtx_Rigid,    random_rigid);
+    bench_inverse("inverse diagonal", Mtx_Affine | Mtx_Diagonal, random_diagonal);
+    bench_inverse("inverse affine",   Mtx_Affine,                random_affine);
+    bench_inverse("inverse general",  Mtx_General,               random_general);
+    bench("mtx", "inverse general (forced)", 1 << 20, [&]() {
+        for (int i = 0; i < 1 << 20; i++) bench_keep(b[i % NUM_INPUTS].inv_general());
+    });
+
+    static Vec4 in[BATCH_SIZE], out[BATCH_SIZE];
+    for (Vec4& vec : in) vec = Vec4(random_vec3() * 32, 1);
+    Mtx mtx = a[0] * b[0];
+    bench("mtx", "mtx * vec4", 1 << 20, [&]() {
+        for (int i = 0; i < 1 << 20; i++) bench_keep(mtx * in[i % BATCH_SIZE]);
+    });
+    bench("mtx", "transform (per vec4)", BATCH_SIZE * 1024, [&]() {
+        for (int i = 0; i < 1024; i++) {
+            mtx.transform(in, out, BATCH_SIZE);
+            bench_keep(out);
+        }
+    });
+}
+
+static void bench_vec() {
+    static Vec3 a[NUM_INPUTS], b[NUM_INPUTS];
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        a[i] = random_vec3();
+        b[i] = random_vec3();
+    }
+    bench("vec", "vec3 add + scale", 1 << 22, [&]() {
+        for (int i = 0; i < 1 << 22; i++) bench_keep((a[i % NUM_INPUTS] + b[(i + 1) % NUM_INPUTS]) * .5f);
+    });
+    bench("vec", "vec3 dot", 1 << 22, [&]() {
+        for (int i = 0; i < 1 << 22; i++) bench_keep(a[i % NUM_INPUTS].dot(b[(i + 1) % NUM_INPUTS]));
+    });
+    bench("vec", "vec3 cross", 1 << 22, [&]() {
+        for (int i = 0; i < 1 << 22; i++) bench_keep(a[i % NUM_INPUTS].cross(b[(i + 1) % NUM_INPUTS]));
+    });
+    bench("vec", "vec3 normalized", 1 << 22, [&]() {
+        for (int i = 0; i < 1 << 22; i++) bench_keep(a[i % NUM_INPUTS].normalized());
+    });
+    bench("vec", "vec4 divide", 1 << 22, [&]() {
+        for (int i = 0; i < 1 << 22; i++) bench_keep(Vec4(a[i % NUM_INPUTS], 2).divide());
+    });
+}
+
+static void bench_texture() {
+    static IVec4 srcs[NUM_INPUTS];
+    for (int i = 0; i < NUM_INPUTS; i++) srcs[i] = IVec4(rand() % 5 * 16, rand() % 4 * 16, 16, 16);
+    bench("texture", "construct", 1 << 20, [&]() {
+        for (int i = 0; i < 1 << 20; i++) bench_keep(Texture(srcs[i % NUM_INPUTS], (Rotation)(i % 4), (Flip)(i / 4 % 3)));
+    });
+}
+
+void bench_math() {
+    srand(1);
+    bench_mtx();
+    bench_vec();
+    bench_texture();
+}
@@ -0,0 +1,228 @@
+#include "bench.h"
+
+#include "types.h"
+#include "world.h"
+#include "renderer.h"
+#include "selection.h"
+#include "file_io.h"
+#include "jobs.h"
+#include "project.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
+#define NUM_RAYS 4096
+
+enum WorldKind {
+    World_Empty,
+    World_Floor,   // one layer of ground, what a new project starts as once you click around
+    World_Terrain, // hills of dirt and ground with water in the dips and a foreground strip
+    World_Sparse,  // 10% random blocks
+    World_Dense,   // 50% random blocks
+    World_Overworld, // the terrain stretched over 256x64x256, mostly air above and empty chunks
+    World_KindCount
+};
+
+static const char* world_names[World_KindCount] = { "empty", "floor", "terrain", "sparse", "dense", "overworld 256x64x256" };
+
+static void fill_world(World& world, WorldKind kind) {
+    if (kind == World_Overworld) world.resize(256, 64, 256);
+    else world.resize(DEFAULT_WORLD_SIZE, DEFAULT_WORLD_SIZE, DEFAULT_WORLD_SIZE);
+    IVec3 size = world.size();
+    srand(kind + 1);
+    for (int x = 0; x < size.x; x++) {
+        for (int z = 0; z < size.z; z++) {
+            int height = 6 + 4 * sinf(x * .3f) + 3 * cosf(z * .25f);
+            if (kind == World_Overworld) height += 12 + 10 * sinf(x * .023f) * cosf(z * .031f);
+            for (int y = 0; y < size.y; y++) {
+                int block = Block_Air;
+                bool foreground = false;
+                switch (kind) {
+                    case World_Empty: break;
+                    case World_Floor:
+                        if (y == 0) block = Block_Ground;
+                        break;
+                    case World_Terrain:
+                    case World_Overworld:
+                        if      (y < height)     block = Block_Dirt;
+                        else if (y == height)    block = Block_Ground;
+                        else if (y < 5)          block = Block_Water;
+                        foreground = block != Block_Air && x % 32 >= 20 && x % 32 < 24;
+                        break;
+                    case World_Sparse:
+                    case World_Dense:
+                        if (rand() % 100 < (kind == World_Sparse ? 10 : 50)) {
+                            block = Block_Start + rand() % (Block_Count - Block_Start);
+                            foreground = rand() % 2;
+                        }
+                        break;
+                    default: break;
+                }
+                world.set(x, y, z, (BlockID)block, foreground);
+            }
+        }
+    }
+}
+
+static float random_float(float min, float max) {
+    return min + rand() / (float)RAND_MAX * (max - min);
+}
+
+// rays shaped like the editor's: parallel-ish, looking down at the world from outside it
+static void make_rays(IVec3 size, Vec3* origins, Vec3* dirs) {
+    srand(7);
+    Vec3 view = Vec3(.64f, -.42f, .64f).normalized();
+    for (int i = 0; i < NUM_RAYS; i++) {
+        Vec3 target = Vec3(random_float(-4, size.x + 4), random_float(0, size.y / 2), random_float(-4, size.z + 4));
+        dirs[i]    = (view + Vec3(random_float(-.05f, .05f), random_float(-.05f, .05f), random_float(-.05f, .05f))).normalized();
+        origins[i] = target - dirs[i] * (size.y * 2.f);
+    }
+}
+
+static void bench_cast(World& world, const char* name) {
+    static Vec3 origins[NUM_RAYS], dirs[NUM_RAYS];
+    make_rays(world.size(), origins, dirs);
+    bench("cast", name, NUM_RAYS * 16, [&]() {
+        for (int n = 0; n < 16; n++) {
+            for (int i = 0; i < NUM_RAYS; i++) {
+                Selection selection = { IVec3(-1, -1, -1), IVec3() };
+                cast(world, origins[i], dirs[i], &selection);
+                bench_keep(selection);
+            }
+        }
+    });
+}
+
+static void bench_mesh(World& world, const char* name) {
+    bench("mesh", name, 1, [&]() {
+        bench_keep(mesh_voxels(world, BackgroundOnly));
+        bench_keep(mesh_voxels(world, ForegroundOnly));
+    });
+}
+
+// a full rebuild of both contexts, like after opening a project, against the number of threads meshing chunks.
+// the other mesh cases run on the calling thread alone
+static void bench_rebuild(World& world, const char* name) {
+    int cores = std::thread::hardware_concurrency();
+    for (int threads = 1; threads <= cores; threads = threads * 2 > cores && threads < cores ? cores : threads * 2) {
+        char full_name[64];
+        snprintf(full_name, sizeof(full_name), "%s, %d thread%s", name, threads, threads == 1 ? "" : "s");
+        start_jobs(threads - 1);
+        bench("rebuild", full_name, 1, [&]() {
+            bench_keep(mesh_voxels(world, BackgroundOnly));
+            bench_keep(mesh_voxels(world, ForegroundOnly));
+        });
+        stop_jobs();
+    }
+}
+
+// reading every cell, the way the mesher and ray cast see the chunked storage, against a plain byte array
+static void bench_scan(World& world) {
+    IVec3 size = world.size();
+    std::vector<unsigned char> bytes(size.x * size.y * size.z);
+    for (int x = 0; x < size.x; x++) {
+        for (int y = 0; y < size.y; y++) {
+            for (int z = 0; z < size.z; z++) bytes[(x * size.y + y) * size.z + z] = world.get(x, y, z);
+        }
+    }
+    const long cells = (long)size.x * size.y * size.z;
+    bench("scan", "indexed (per cell)", cells * 8, [&]() {
+        for (int n = 0; n < 8; n++) {
+            int solid = 0;
+            for (int x = 0; x < size.x; x++) {
+                for (int y = 0; y < size.y; y++) {
+                    for (int z = 0; z < size.z; z++) solid += world[x][y][z] != Block_Air;
+                }
+            }
+            bench_keep(solid);
+        }
+    });
+    bench("scan", "rows (per cell)", cells * 8, [&]() {
+        std::vector<BlockID> row(size.z);
+        for (int n = 0; n < 8; n++) {
+            int solid = 0;
+            for (int x = 0; x < size.x; x++) {
+                for (int y = 0; y < size.y; y++) {
+                    world.get_row(x, y, row.data());
+                    for (int z = 0; z < size.z; z++) solid += row[z] != Block_Air;
+                }
+            }
+            bench_keep(solid);
+        }
+    });
+    bench("scan", "byte array (per cell)", cells * 8, [&]() {
+        for (int n = 0; n < 8; n++) {
+            int solid = 0;
+            for (size_t i = 0; i < bytes.size(); i++) solid += bytes[i] != Block_Air;
+            bench_keep(solid);
+        }
+    });
+}
+
+// saving and opening a project, without the file system
+static void bench_project(World& world, const char* name) {
+    IVec3 size = world.size();
+    const long cells = (long)size.x * size.y * size.z;
+    std::vector<unsigned char> data;
+    encode_project(world, &data);
+    char full_name[64];
+    snprintf(full_name, sizeof(full_name), "encode %s (per cell)", name);
+    bench("io", full_name, cells, [&]() {
+        encode_project(world, &data);
+        bench_keep(data[0]);
+    });
+    World loaded(1, 1, 1);
+    snprintf(full_name, sizeof(full_name), "decode %s (per cell)", name);
+    bench("io", full_name, cells, [&]() {
+        bench_keep(decode_project(data.data(), data.size(), loaded));
+    });
+    // opening it from disk the way the editor does, read in one go and unpacked on every core
+    const char* filename = "bench_project.wrl";
+    write_file(filename, data);
+    start_jobs();
+    snprintf(full_name, sizeof(full_name), "open %s (per cell)", name);
+    bench("io", full_name, cells, [&]() {
+        std::vector<unsigned char> file;
+        read_file(filename, &file);
+        bench_keep(decode_project(file.data(), file.size(), loaded));
+    });
+    stop_jobs();
+    remove(filename);
+    // what a save costs the main thread, the rest happens on the save thread
+    IVec3 count = world.chunk_count();
+    snprintf(full_name, sizeof(full_name), "snapshot %s (per chunk)", name);
+    bench("io", full_name, count.x * count.y * count.z, [&]() {
+        world.snapshot(loaded);
+        loaded.clear();
+    });
+}
+
+static void bench_blit() {
+    // the shape export uses: a 768x512 render scaled down into a 384x256 cell of the sheet
+    Image* output  = create_image(384 * 4, 256 * 2);
+    Image* texture = create_image(768, 512);
+    for (int i = 0; i < texture->width * texture->height; i++) texture->pixels[i] = { (uint8_t)i, (uint8_t)(i >> 8), (uint8_t)(i >> 16), 255 };
+    bench("io", "blit_image (per pixel)", 384 * 256 * 8, [&]() {
+        for (int i = 0; i < 8; i++) blit_image(output, texture, i % 4 * 384, i / 4 * 256, 384, 256);
+        bench_keep(output->pixels[0]);
+    });
+    free_image(texture);
+    free_image(output);
+}
+
+void bench_world() {
+    static World world;
+    for (int kind = 0; kind < World_KindCount; kind++) {
+        fill_world(world, (WorldKind)kind);
+        bench_cast(world, world_names[kind]);
+        bench_mesh(world, world_names[kind]);
+        if (kind == World_Terrain) bench_scan(world);
+        if (kind == World_Terrain || kind == World_Overworld) bench_project(world, kind == World_Terrain ? "terrain" : "overworld");
+        if (kind == World_Overworld) bench_rebuild(world, world_names[kind]);
+    }
+    bench_blit();
+}
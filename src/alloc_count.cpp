@@ -0,0 +1,33 @@
+#include "alloc_count.h"
+
+#include <stdlib.h>
+
+thread_local size_t heap_allocations = 0;
+
+// replaces the global allocation functions so heap use can be counted, the aligned variants are left alone
+void* operator new(size_t size) {
+    heap_allocations++;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <new>
+
+// counts calls to the global operator new on the calling thread, the main loop checks its own count stays put
+// once it has warmed up, the job threads are free to allocate
+extern thread_local size_t heap_allocations;
+
+// stack with a fixed capacity that never touches the heap, for types without a default constructor
+template<typename T, int N> struct FixedStack {
+    ~FixedStack() {
+        clear();
+    }
+    bool push(const T& value) {
+        if (count == N) {
+            printf("Stack overflow (capacity %d)\n", N);
+            return false;
+        }
+        new (storage + count * sizeof(T)) T(value);
+        count++;
+        return true;
+    }
+    void pop() {
+        if (count == 0) return;
+        back().~T();
+        count--;
+    }
+    T& back() {
+        return *(T*)(storage + (count - 1) * sizeof(T));
+    }
+    void clear() {
+        while (count > 0) pop();
+    }
+    int size() const {
+        return count;
+    }
+private:
+    alignas(T) unsigned char storage[N * sizeof(T)];
+    int count = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#ifndef BLOCK_INFO_H
+#define BLOCK_INFO_H
+
+#include "types.h"
+
+template<typename T> constexpr void swap(T& a, T& b) {
+    T temp = a;
+    a = b;
+    b = temp;
+}
+
+enum Flip {
+    Flip_None,
+    Flip_XAxis,
+    Flip_YAxis
+};
+
+enum Rotation {
+    deg0,
+    deg90,
+    deg180,
+    deg270
+};
+
+// same order as the texture arguments of draw_box
+enum Face {
+    Face_PosY = 1 << 0,
+    Face_NegY = 1 << 1,
+    Face_PosX = 1 << 2,
+    Face_NegX = 1 << 3,
+    Face_PosZ = 1 << 4,
+    Face_NegZ = 1 << 5,
+    Face_All  = 0x3F
+};
+
+struct Texture {
+    IVec4 src;
+    Flip flip;
+    Rotation rot;
+
+    Vec2 uv[4];
+    Vec4 rect; // src in uv space
+
+    constexpr Texture(IVec4 src = IVec4(), Rotation rot = deg0, Flip flip = Flip_None): src(src), flip(flip), rot(rot) {
+        rect = Vec4(
+            src.x / (float)TILEMAP_WIDTH,
+            src.y / (float)TILEMAP_HEIGHT,
+            src.z / (float)TILEMAP_WIDTH,
+            src.w / (float)TILEMAP_HEIGHT
+        );
+        uv[0] = Vec2(rect.x + rect.z, rect.y + rect.w);
+        uv[1] = Vec2(rect.x,          rect.y + rect.w);
+        uv[2] = Vec2(rect.x,          rect.y         );
+        uv[3] = Vec2(rect.x + rect.z, rect.y         );
+
+        switch (flip) {
+            case Flip_None: break;
+            case Flip_XAxis:
+                swap(uv[2], uv[3]);
+                swap(uv[0], uv[1]);
+                break;
+            case Flip_YAxis:
+                swap(uv[1], uv[2]);
+                swap(uv[0], uv[3]);
+                break;
+        }
+        for (int i = 0; i < rot; i++) {
+            swap(uv[2], uv[3]);
+            swap(uv[1], uv[2]);
+            swap(uv[0], uv[1]);
+        }
+    }
+    constexpr bool operator ==(const Texture& other) const {
+        return src.x == other.src.x && src.y == other.src.y && src.z == other.src.z && src.w == other.src.w && rot == other.rot && flip == other.flip;
+    }
+};
+
+enum BlockFlags {
+    BlockFlag_Solid      = 1 << 0, // stops the selection ray
+    BlockFlag_Opaque     = 1 << 1, // hides the touching faces of other opaque blocks
+    BlockFlag_FullCube   = 1 << 2, // fills the whole cell, faces can be merged by the mesher
+    BlockFlag_HalfHeight = 1 << 3,
+    BlockFlag_Animated   = 1 << 4, // the top face steps through 4 frames stacked below each other in the tileset
+    BlockFlag_Liquid     = 1 << 5, // only a bed at from.y (negy texture) and a surface at to.y (posy texture), both facing up
+};
+
+struct BlockInfo {
+    int flags;
+    Vec3 from, to;
+    Texture faces[6]; // same order as Face
+};
+
+#define SLICE(x) x, x
+#define SIDES(x) x, x, x, x
+#define FACES(x) x, x, x, x, x, x
+
+#define CUBE   BlockFlag_Solid | BlockFlag_Opaque | BlockFlag_FullCube, Vec3(0, 0, 0), Vec3(1, 1, 1)
+#define BRIDGE BlockFlag_Solid | BlockFlag_HalfHeight, Vec3(0, 0.5, 0), Vec3(1, 1, 1)
+#define WATER  BlockFlag_Solid | BlockFlag_Liquid | BlockFlag_Animated, Vec3(0, 0, 0), Vec3(1, 0.125, 1)
+
+inline constexpr BlockInfo block_info[Block_Count] = {
+    /* Block_Air           */ { 0, Vec3(), Vec3(), {} },
+    /* Block_Dirt          */ { CUBE, { FACES(IVec4(32, 0, 16, 16)) } },
+    /* Block_DirtWall      */ { CUBE, { SLICE(IVec4(32, 0, 16, 16)), SIDES(IVec4(48, 0, 16, 16)) } },
+    /* Block_Ground        */ { CUBE, { IVec4(0, 0, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_PathStraight1 */ { CUBE, { IVec4(32, 16, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_PathStraight2 */ { CUBE, { IVec4(32, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_PathCurved1   */ { CUBE, { IVec4(0, 16, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_PathCurved2   */ { CUBE, { IVec4(16, 16, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_PathCurved3   */ { CUBE, { IVec4(0, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_PathCurved4   */ { CUBE, { IVec4(16, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_Intersection  */ { CUBE, { IVec4(48, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_Level         */ { CUBE, { IVec4(48, 48, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16)) } },
+    /* Block_Bridge1       */ { BRIDGE, { SLICE(Texture(IVec4(0, 48, 16, 16), deg90)), SLICE(IVec4(16, 48, 16, 8)), SLICE(IVec4(16, 56, 16, 8)) } },
+    /* Block_Bridge2       */ { BRIDGE, { SLICE(Texture(IVec4(0, 48, 16, 16), deg0 )), SLICE(IVec4(16, 56, 16, 8)), SLICE(IVec4(16, 48, 16, 8)) } },
+    /* Block_Water         */ { WATER, { IVec4(64, 0, 16, 16), IVec4(48, 16, 16, 16) } },
+};
+
+#undef CUBE
+#undef BRIDGE
+#undef WATER
+
+#endif
\ No newline at end of file
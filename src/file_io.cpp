@@ -0,0 +1,322 @@
+#include "file_io.h"
+#include "types.h"
+
+#include "renderer.h"
+#include "project.h"
+#include "jobs.h"
+
+#include <GL/glew.h>
+#include <SDL3/SDL.h>
+
+#include <string>
+#include <stdlib.h>
+#include <vector>
+
+#define AUTOSAVE_MS (60 * 1000)
+#define SAVE_POLL_MS 50
+#define JOURNAL_COMPACT_BYTES (1 << 20) // about 200k edits
+#define EXPORT_FRAMES    8 // 4 animation frames, each background then foreground
+#define EXPORT_READBACKS 3
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "lib/stb_image.h"
+#include "lib/stb_image_write.h"
+#include "lib/portable-file-dialogs.h"
+
+Image* create_image(int width, int height) {
+    Image* image  = (Image*)malloc(sizeof(Image));
+    image->pixels = (Pixel*)malloc(sizeof(Pixel) * width * height);
+    image->width  = width;
+    image->height = height;
+    return image;
+}
+
+void blit_image(Image* out, Image* in, int x, int y, int w, int h) {
+    for (int Y = 0; Y < h; Y++) {
+        for (int X = 0; X < w; X++) {
+            out->px(X + x, Y + y) = in->px(X * in->width / w, in->height - 1 - (Y * in->height / h));
+        }
+    }
+}
+
+void free_image(Image* image) {
+    free(image->pixels);
+    free(image);
+}
+
+std::string open_file(std::string title, std::string filter_name, std::string filter) {
+    std::vector<std::string> files = pfd::open_file(title, ".", { filter_name, filter }).result();
+    if (files.empty()) return "";
+    return files[0];
+}
+
+std::string save_file(std::string title, std::string filter_name, std::string filter_ext) {
+    return pfd::save_file(title, ".", { filter_name, filter_ext }).result();
+}
+
+// the save dialog stays open while the editor keeps running, update_saving picks up the answer
+static pfd::save_file* save_dialog = NULL;
+// opened from or last saved to. edits go to the journal next to it, without a journal they get autosaved
+static std::string project_filename;
+static std::string pending_save; // picked while another save was still being written
+static std::string saving_filename;
+enum SaveKind {
+    Save_Project,
+    Save_Autosave,
+    Save_Compaction, // the journal into the project
+};
+static bool saving = false;
+static SaveKind saving_kind;
+static unsigned int saved_version = 0;  // world.version of the last autosave that made it to disk
+static unsigned int saving_version = 0; // and of the one being written
+static Uint64 last_autosave = 0;
+static Uint64 compact_retry = 0; // after a failed compaction the journal waits this long before it tries again
+static const char* save_message = "";
+
+static bool begin_save(World& world, const std::string& filename, SaveKind kind) {
+    if (!start_save(world, filename.c_str())) return false;
+    saving = true;
+    saving_kind = kind;
+    saving_filename = filename;
+    saving_version = world.version;
+    save_message = kind == Save_Autosave ? "autosaving..." : "saving...";
+    return true;
+}
+
+static void end_save(World& world, SaveStatus status) {
+    saving = false;
+    bool saved = status == Save_Done;
+    if (saving_kind == Save_Autosave && saved) saved_version = saving_version;
+    if (saving_kind == Save_Compaction) finish_compacting(saved);
+    if (saving_kind == Save_Compaction && !saved) compact_retry = SDL_GetTicks() + AUTOSAVE_MS;
+    // the journal held on to the edits made during the save, they go after the new base
+    if (saving_kind == Save_Project && saved) {
+        project_filename = saving_filename;
+        create_journal(project_filename.c_str(), world.size());
+    }
+    else if (saving_kind == Save_Project && !project_filename.empty()) append_journal(project_filename.c_str(), world.size());
+    else if (saving_kind == Save_Project) close_journal();
+    save_message = !saved ? "save failed" : saving_kind == Save_Autosave ? "autosaved" : "saved";
+}
+
+static void wait_for_save(World& world) {
+    while (saving) {
+        SaveStatus status = poll_save();
+        if (status == Save_Running) SDL_Delay(1);
+        else end_save(world, status);
+    }
+}
+
+static void compact(World& world) {
+    start_compacting();
+    if (begin_save(world, project_filename, Save_Compaction)) return;
+    finish_compacting(false);
+    compact_retry = SDL_GetTicks() + AUTOSAVE_MS;
+}
+
+void read_project(World& world) {
+    std::string filename = open_file("Open Project", "BTCB World Map Project", "*.wrl");
+    if (filename.empty()) return;
+    std::vector<unsigned char> data;
+    if (!read_file(filename.c_str(), &data)) return;
+    wait_for_save(world);
+    bool opened = decode_project(data.data(), data.size(), world);
+    if (!opened) {
+        printf("Could not open %s\n", filename.c_str());
+        return;
+    }
+    // after a crash the journal has what the base is missing
+    close_journal();
+    replay_journals(filename.c_str(), world);
+    append_journal(filename.c_str(), world.size());
+    project_filename = filename;
+    saved_version = world.version;
+}
+
+void write_project(World& world, bool save_as) {
+    // the journal is held until the save being written ends, it reports "saved" once the edits are on disk
+    if (!save_as && saving && saving_kind == Save_Project) return;
+    // the journal already has every edit, it only has to reach the disk
+    if (!save_as && journaling() && !project_filename.empty()) {
+        save_message = flush_journal(true) ? "saved" : "save failed";
+        return;
+    }
+    if (save_dialog) return;
+    save_dialog = new pfd::save_file("Save Project", ".", { "BTCB World Map Project", "*.wrl" });
+}
+
+void new_project(World& world) {
+    wait_for_save(world);
+    close_journal();
+    project_filename.clear();
+    world.clear();
+    saved_version = world.version;
+}
+
+bool update_saving(World& world) {
+    Uint64 now = SDL_GetTicks();
+    if (last_autosave == 0) {
+        last_autosave = now;
+        saved_version = world.version;
+    }
+    bool touched_heap = save_dialog != NULL;
+    if (!flush_journal(false)) save_message = "save failed";
+
+    if (save_dialog && save_dialog->ready(0)) {
+        pending_save = save_dialog->result();
+        delete save_dialog;
+        save_dialog = NULL;
+    }
+    if (!pending_save.empty() && !saving) {
+        if (pending_save == project_filename) compact(world);
+        else if (begin_save(world, pending_save, Save_Project)) {
+            // a journal left next to the file would be replayed over the new base
+            remove_journals(pending_save.c_str());
+            hold_journal();
+        }
+        pending_save.clear();
+        touched_heap = true;
+    }
+    if (!saving && journaling() && !project_filename.empty() && journal_size() >= JOURNAL_COMPACT_BYTES && now >= compact_retry) {
+        compact(world);
+        touched_heap = true;
+    }
+    if (now - last_autosave >= AUTOSAVE_MS) {
+        last_autosave = now;
+        if (!journaling() && world.version != saved_version && !saving) {
+            std::string filename = project_filename.empty() ? "autosave.wrl" : project_filename + ".autosave";
+            touched_heap |= begin_save(world, filename, Save_Autosave);
+        }
+    }
+
+    // finishing builds the journal paths and may take over the filename
+    SaveStatus status = poll_save();
+    if (saving && status != Save_Running) {
+        end_save(world, status);
+        touched_heap = true;
+    }
+    return touched_heap;
+}
+
+int save_timeout(const World& world) {
+    if (save_dialog || saving || !pending_save.empty()) return SAVE_POLL_MS;
+    if (journaling() || world.version == saved_version) return -1;
+    Uint64 elapsed = SDL_GetTicks() - last_autosave;
+    return elapsed >= AUTOSAVE_MS ? 0 : AUTOSAVE_MS - elapsed;
+}
+
+const char* save_status() {
+    return save_message;
+}
+
+void finish_saving(World& world) {
+    wait_for_save(world);
+    close_journal();
+    stop_saving();
+}
+
+static void render_world(World& world, WorldContext context, int anim_frame) {
+    prepare_rendering(world);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glColor4f(1.f, 1.f, 1.f, 1.f);
+    draw_voxels(world, context, anim_frame);
+}
+
+struct ExportBlit {
+    Image* output;
+    Image frame; // its pixels are a mapped pixel buffer
+    int x, y;
+};
+
+static void run_export_blit(void* data) {
+    ExportBlit* blit = (ExportBlit*)data;
+    blit_image(blit->output, &blit->frame, blit->x, blit->y, 384, 256);
+}
+
+struct ExportEncode {
+    Image* output;
+    std::string filename;
+    Uint64 started;
+};
+
+static void run_export_encode(void* data) {
+    ExportEncode* encode = (ExportEncode*)data;
+    if (stbi_write_png(encode->filename.c_str(), encode->output->width, encode->output->height, 4, encode->output->pixels, 0)) {
+        printf("Exported %s in %.1f ms\n", encode->filename.c_str(), (SDL_GetTicksNS() - encode->started) / 1e6);
+    }
+    else printf("Could not write %s\n", encode->filename.c_str());
+    free_image(encode->output);
+    delete encode;
+}
+
+void export_project(World& world) {
+    std::string filename = save_file("Export Project", "PNG Image", "*.png");
+    if (filename.empty()) return;
+    Uint64 started = SDL_GetTicksNS();
+
+    Image* output = create_image(384 * 4, 256 * 2); // 4 animation states * fg,bg
+    prepare_rendering(world);
+    finish_voxel_meshes(world);
+
+    // the frames are read back through a ring of pixel buffers: one transfers while the next one renders, and once
+    // that's submitted it gets mapped and blitted into the sheet on the job threads
+    GLuint buffers[EXPORT_READBACKS];
+    bool mapped[EXPORT_READBACKS] = {};
+    ExportBlit blits[EXPORT_FRAMES];
+    JobGroup blit_group;
+    glGenBuffers(EXPORT_READBACKS, buffers);
+    for (int i = 0; i < EXPORT_READBACKS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 768 * 512 * sizeof(Pixel), NULL, GL_STREAM_READ);
+    }
+    for (int frame = 0; frame <= EXPORT_FRAMES; frame++) {
+        if (frame < EXPORT_FRAMES) {
+            int slot = frame % EXPORT_READBACKS;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[slot]);
+            if (mapped[slot]) {
+                // the blit out of it has to be done before it's read into again
+                wait_jobs(&blit_group);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                mapped[slot] = false;
+            }
+            render_world(world, frame % 2 ? ForegroundOnly : BackgroundOnly, frame / 2);
+            glReadPixels(0, 0, 768, 512, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        }
+        if (frame > 0) {
+            int done = frame - 1;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[done % EXPORT_READBACKS]);
+            Pixel* pixels = (Pixel*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+            mapped[done % EXPORT_READBACKS] = pixels != NULL;
+            if (!pixels) {
+                printf("Could not read back export frame %d\n", done);
+                continue;
+            }
+            blits[done] = { output, { 768, 512, pixels }, done / 2 * 384, done % 2 * 256 };
+            push_job(run_export_blit, &blits[done], &blit_group);
+        }
+    }
+    wait_jobs(&blit_group);
+    for (int i = 0; i < EXPORT_READBACKS; i++) {
+        if (!mapped[i]) continue;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(EXPORT_READBACKS, buffers);
+
+    // the editor keeps going while the sheet gets compressed, without worker threads it happens right here
+    push_job(run_export_encode, new ExportEncode { output, filename, started });
+}
+
+void read_tileset(GLuint* texture) {
+    std::string filename = open_file("Load Image", "PNG Image", "*.png");
+    if (filename.empty()) return;
+
+    int x, y, c;
+    unsigned char* image = stbi_load(filename.c_str(), &x, &y, &c, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TILEMAP_WIDTH, TILEMAP_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    stbi_image_free(image);
+    tileset_version++;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+#include "types.h"
+#include "world.h"
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+struct Pixel {
+    uint8_t r, g, b, a;
+};
+
+struct Image {
+    int width, height;
+    Pixel* pixels;
+    Pixel& px(int x, int y) {
+        return pixels[y * width + x];
+    }
+};
+
+Image* create_image(int width, int height);
+void blit_image(Image* out, Image* in, int x, int y, int w, int h); // scales in to w*h and flips it vertically
+void free_image(Image* image);
+
+// replays the journal left next to the project, if there is one
+void read_project(World& world);
+// with a project open its journal gets synced, otherwise and for save_as this opens the save dialog and the save
+// itself starts from update_saving
+void write_project(World& world, bool save_as);
+void new_project(World& world);
+// once per frame, picks up the save dialog's answer, starts autosaves and follows the save thread.
+// true when it touched the heap doing so
+bool update_saving(World& world);
+int save_timeout(const World& world); // ms until update_saving has something to do, -1 for nothing
+const char* save_status(); // for the window title, empty until the first save
+void finish_saving(World& world); // waits for a running save and closes the journal
+void export_project(World& world);
+void read_tileset(GLuint* texture);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "jobs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct Job {
+    JobFunction run;
+    void* data;
+    JobGroup* group;
+};
+
+// ring buffer, the owner pushes and pops at the back and thieves take from the front
+struct JobQueue {
+    std::mutex lock;
+    Job jobs[JOB_QUEUE_SIZE];
+    int head = 0;
+    int count = 0;
+};
+
+// queue 0 belongs to the threads outside the pool, 1 to num_threads to the workers
+static JobQueue queues[MAX_JOB_THREADS + 1];
+static std::thread threads[MAX_JOB_THREADS];
+static int num_threads = 0;
+static int next_queue = 0;
+static thread_local int own_queue = 0;
+
+static std::atomic<int> queued(0);     // sitting in a queue
+static std::atomic<int> unfinished(0); // pushed and not done yet
+static std::mutex sleep_lock;
+static std::condition_variable wake;
+static bool stopping = false;
+
+static bool pop_back(JobQueue* queue, Job* job) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    if (queue->count == 0) return false;
+    queue->count--;
+    *job = queue->jobs[(queue->head + queue->count) % JOB_QUEUE_SIZE];
+    return true;
+}
+
+static bool pop_front(JobQueue* queue, Job* job) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    if (queue->count == 0) return false;
+    *job = queue->jobs[queue->head];
+    queue->head = (queue->head + 1) % JOB_QUEUE_SIZE;
+    queue->count--;
+    return true;
+}
+
+// takes one of the group's jobs from anywhere in the queue, the last one fills its place
+static bool pop_group(JobQueue* queue, JobGroup* group, Job* job) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    for (int i = 0; i < queue->count; i++) {
+        Job& slot = queue->jobs[(queue->head + i) % JOB_QUEUE_SIZE];
+        if (slot.group != group) continue;
+        *job = slot;
+        queue->count--;
+        slot = queue->jobs[(queue->head + queue->count) % JOB_QUEUE_SIZE];
+        return true;
+    }
+    return false;
+}
+
+static bool take_job(Job* job) {
+    if (pop_back(&queues[own_queue], job)) return true;
+    for (int i = 1; i <= num_threads; i++) {
+        if (pop_front(&queues[(own_queue + i) % (num_threads + 1)], job)) return true;
+    }
+    return false;
+}
+
+static bool take_group_job(JobGroup* group, Job* job) {
+    for (int i = 0; i <= num_threads; i++) {
+        if (pop_group(&queues[(own_queue + i) % (num_threads + 1)], group, job)) return true;
+    }
+    return false;
+}
+
+static void run_job(const Job& job) {
+    queued--;
+    job.run(job.data);
+    if (job.group) job.group->unfinished--;
+    unfinished--;
+}
+
+static void worker(int index) {
+    own_queue = index;
+    while (true) {
+        Job job;
+        if (take_job(&job)) {
+            run_job(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_lock);
+        wake.wait(lock, []() { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+void start_jobs(int count) {
+    if (num_threads > 0) stop_jobs();
+    if (count < 0) count = (int)std::thread::hardware_concurrency() - 1;
+    if (count < 0) count = 0;
+    if (count > MAX_JOB_THREADS) count = MAX_JOB_THREADS;
+    stopping = false;
+    num_threads = count;
+    for (int i = 0; i < num_threads; i++) threads[i] = std::thread(worker, i + 1);
+}
+
+void stop_jobs() {
+    wait_jobs();
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (int i = 0; i < num_threads; i++) threads[i].join();
+    num_threads = 0;
+}
+
+int job_threads() {
+    return num_threads;
+}
+
+void push_job(JobFunction run, void* data, JobGroup* group) {
+    // without workers nothing would pick it up before someone waits, and the main loop never does
+    if (num_threads == 0) {
+        run(data);
+        return;
+    }
+    // workers keep what they spawn, everyone else deals the jobs out round robin
+    int index = own_queue;
+    if (index == 0 && num_threads > 0) {
+        next_queue = next_queue % num_threads + 1;
+        index = next_queue;
+    }
+    JobQueue* queue = &queues[index];
+    unfinished++;
+    if (group) group->unfinished++;
+    bool full;
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        full = queue->count == JOB_QUEUE_SIZE;
+        if (!full) {
+            queue->jobs[(queue->head + queue->count) % JOB_QUEUE_SIZE] = { run, data, group };
+            queue->count++;
+            queued++;
+        }
+    }
+    if (full) {
+        run(data);
+        if (group) group->unfinished--;
+        unfinished--;
+        return;
+    }
+    // taken once so a worker that just found nothing can't go to sleep past this notify
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+    }
+    wake.notify_one();
+}
+
+void wait_jobs(JobGroup* group) {
+    if (group) {
+        // only the group's own jobs get helped with, anything else could keep the caller busy for far longer
+        while (group->unfinished > 0) {
+            Job job;
+            if (take_group_job(group, &job)) run_job(job);
+            else std::this_thread::yield();
+        }
+        return;
+    }
+    while (unfinished > 0) {
+        Job job;
+        if (take_job(&job)) run_job(job);
+        else std::this_thread::yield();
+    }
+}
\ No newline at end of file
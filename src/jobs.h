@@ -0,0 +1,29 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stddef.h>
+
+#include <atomic>
+
+#define MAX_JOB_THREADS 64
+#define JOB_QUEUE_SIZE  256 // per queue, push_job runs the job itself once its queue is full
+
+// work-stealing pool: every worker has its own queue and takes from its back, once that runs dry it
+// steals from the front of the others. jobs pushed from outside the pool are spread over the queues
+typedef void (*JobFunction)(void* data);
+
+// counts its jobs that haven't finished, so a caller can wait for its own work and nobody else's
+struct JobGroup {
+    std::atomic<int> unfinished{0};
+};
+
+// -1 starts one worker per core besides the calling thread, with 0 push_job runs every job right away
+void start_jobs(int num_threads = -1);
+void stop_jobs(); // waits for the pushed jobs first
+int job_threads();
+void push_job(JobFunction run, void* data, JobGroup* group = NULL);
+// the calling thread helps with the group's jobs until they've all finished, without a group it waits for every
+// pushed job
+void wait_jobs(JobGroup* group = NULL);
+
+#endif
\ No newline at end of file
@@ -1,12 +1,27 @@
 #include <SDL3/SDL.h>
-#include <GL/gl.h>
+#include <GL/glew.h>
 #include <cstdio>
+#include <cstdlib>
+#include <assert.h>
 
 #include "renderer.h"
 #include "selection.h"
-#include "io.h"
+#include "file_io.h"
+#include "alloc_count.h"
+#include "jobs.h"
+#include "project.h"
+
+#define WARMUP_FRAMES 8
+
+int main(int argc, char** argv) {
+    // wrledit [width height depth], a project that gets opened brings its own size
+    IVec3 size = IVec3(DEFAULT_WORLD_SIZE, DEFAULT_WORLD_SIZE, DEFAULT_WORLD_SIZE);
+    if (argc == 4) size = IVec3(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+    if ((argc != 1 && argc != 4) || size.x < 1 || size.y < 1 || size.z < 1 || size.x > MAX_WORLD_SIZE || size.y > MAX_WORLD_SIZE || size.z > MAX_WORLD_SIZE) {
+        printf("usage: %s [width height depth], each between 1 and %d\n", argv[0], MAX_WORLD_SIZE);
+        return 1;
+    }
 
-int main() {
     SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
@@ -16,28 +31,43 @@ int main() {
 
     SDL_Window* window = SDL_CreateWindow("", 768, 512, SDL_WINDOW_OPENGL);
     SDL_GLContext context = SDL_GL_CreateContext(window);
+    SDL_GL_SetSwapInterval(1);
+    glewInit();
+    start_jobs();
     bool running = true;
 
-    World world;
+    World world(size.x, size.y, size.z);
     BlockID curr_block = Block_Water;
     BlockID selected_block = Block_Air;
-    memset(world, 0, sizeof(World));
 
     bool selection_active = false;
     bool ctrl = false;
     bool alt  = false;
     float sel_x, sel_y;
     float near_plane = .1f;
+    RenderStats shown_stats = {};
+    const char* shown_save_status = NULL;
+    bool redraw = true;
+    int timeout = 0;
+    int frames_drawn = 0;
+    unsigned int last_drawn_version = world.version;
 
     while (running) {
         bool mouse_left  = false;
         bool mouse_right = false;
 
+        // sleep until there's input or the next animation step is due
+        SDL_Event event;
+        bool has_event = SDL_WaitEventTimeout(&event, redraw ? 0 : timeout);
+        if (!has_event && !redraw && timeout < 0) continue;
+        redraw = false;
+        size_t frame_allocations = heap_allocations;
+        bool file_action = false;
+
         float mouse_x, mouse_y;
         SDL_GetMouseState(&mouse_x, &mouse_y);
 
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
+        for (; has_event; has_event = SDL_PollEvent(&event)) {
             if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN) {
                 if (event.button.button == SDL_BUTTON_LEFT)  mouse_left  = true;
                 if (event.button.button == SDL_BUTTON_RIGHT) mouse_right = true;
@@ -49,13 +79,19 @@ int main() {
                     selection_active = true;
                 }
                 if (event.key.key == SDLK_LALT)  alt  = true;
+                // big worlds don't fit the view, the arrow keys move the camera over them
+                if (event.key.key == SDLK_LEFT)  pan_camera(-1,  0);
+                if (event.key.key == SDLK_RIGHT) pan_camera( 1,  0);
+                if (event.key.key == SDLK_UP)    pan_camera( 0,  1);
+                if (event.key.key == SDLK_DOWN)  pan_camera( 0, -1);
                 if (event.key.key == SDLK_LCTRL) ctrl = true;
                 if (ctrl) {
-                    if (event.key.key == SDLK_S) write_project(world);
+                    file_action |= event.key.key == SDLK_S || event.key.key == SDLK_E || event.key.key == SDLK_O || event.key.key == SDLK_L;
+                    if (event.key.key == SDLK_S) write_project(world, event.key.mod & SDL_KMOD_SHIFT);
                     if (event.key.key == SDLK_E) export_project(world);
                     if (event.key.key == SDLK_O) read_project(world);
                     if (event.key.key == SDLK_L) read_tileset(&tileset_texture);
-                    if (event.key.key == SDLK_N) memset(world, 0, sizeof(World));
+                    if (event.key.key == SDLK_N) new_project(world);
                     if (event.key.key == SDLK_R) near_plane = .1f;
                 }
             }
@@ -71,39 +107,67 @@ int main() {
             if (event.type == SDL_EVENT_MOUSE_WHEEL) {
                 near_plane += event.wheel.y * .25f;
                 if (near_plane < .1f) near_plane = .1f;
-                if (near_plane > 28.f) near_plane = 28.f;
             }
         }
 
-        prepare_rendering(near_plane);
+        file_action |= update_saving(world);
 
-        Selection* selection = get_selection(world, window);
-        if (selection_active) selection->pos = IVec3(-1, -1, -1);
+        // checked every frame, opening a smaller world can leave the slice behind it
+        if (near_plane > view_depth(world)) near_plane = view_depth(world);
+        prepare_rendering(world, near_plane);
 
-        draw_grid();
-        alt ? glColor4f(.5f, .5f, .5f, 1.f) : glColor4f(1.f, 1.f, 1.f, 1.f);
-        draw_voxels(world, BackgroundOnly);
-        glColor4f(1.f, 1.f, 1.f, 1.f);
-        draw_voxels(world, ForegroundOnly);
-        draw_selection(selection);
+        Selection selection = get_selection(world, window);
+        if (selection_active) selection.pos = IVec3(-1, -1, -1);
+
+        draw_world(world, alt);
+        unsigned int drawn_version = world.version;
+        RenderStats stats = voxel_stats();
+        if (stats.quads_emitted != shown_stats.quads_emitted || stats.quads_culled != shown_stats.quads_culled || stats.quads_merged != shown_stats.quads_merged || save_status() != shown_save_status) {
+            char title[128];
+            snprintf(title, sizeof(title), "%d quads, %d culled, %d merged%s%s", stats.quads_emitted, stats.quads_culled, stats.quads_merged, *save_status() ? " - " : "", save_status());
+            SDL_SetWindowTitle(window, title);
+            shown_stats = stats;
+            shown_save_status = save_status();
+        }
+        draw_selection(&selection);
         if (selection_active) selected_block = draw_block_selection(sel_x, sel_y, mouse_x - sel_x, mouse_y - sel_y, curr_block);
 
         if (alt) {
-            if (mouse_left) world[selection->pos.x][selection->pos.y][selection->pos.z] ^= 0x80;
+            IVec3 pos = selection.pos;
+            if (mouse_left && world.in_bounds(pos.x, pos.y, pos.z)) {
+                world.set_foreground(pos.x, pos.y, pos.z, !world.is_foreground(pos.x, pos.y, pos.z));
+                journal_cell(world, pos.x, pos.y, pos.z);
+            }
         }
         else {
-            if (mouse_left) world[selection->pos.x][selection->pos.y][selection->pos.z] = Block_Air;
+            if (mouse_left) {
+                world.set(selection.pos.x, selection.pos.y, selection.pos.z, Block_Air);
+                journal_cell(world, selection.pos.x, selection.pos.y, selection.pos.z);
+            }
             if (mouse_right) {
-                IVec3 pos = selection->pos + selection->normal;
-                if (pos.x >= 0 && pos.y >= 0 && pos.z >= 0 && pos.x < WORLD_SIZE && pos.y < WORLD_SIZE && pos.z < WORLD_SIZE) world[pos.x][pos.y][pos.z] = curr_block;
+                IVec3 pos = selection.pos + selection.normal;
+                world.set(pos.x, pos.y, pos.z, curr_block);
+                journal_cell(world, pos.x, pos.y, pos.z);
             }
         }
 
-        free(selection);
-
         SDL_GL_SwapWindow(window);
-        SDL_Delay(10);
+        timeout = redraw_timeout(SDL_GetWindowFlags(window) & SDL_WINDOW_MOUSE_FOCUS);
+        // come back for the save dialog, the save thread and the next autosave even without input
+        int save_wait = save_timeout(world);
+        if (save_wait >= 0 && (timeout < 0 || save_wait < timeout)) timeout = save_wait;
+        if (world.version != drawn_version) redraw = true;
+
+        // once warmed up, only file dialogs, saves and remeshing an edited world are allowed to touch the heap
+        bool steady = frames_drawn >= WARMUP_FRAMES && !file_action && drawn_version == last_drawn_version && world.version == drawn_version;
+        assert(!steady || heap_allocations == frame_allocations);
+        (void)steady;
+        (void)frame_allocations;
+        last_drawn_version = drawn_version;
+        frames_drawn++;
     }
+    finish_saving(world);
+    stop_jobs();
     SDL_GL_DestroyContext(context);
     SDL_DestroyWindow(window);
     return 0;
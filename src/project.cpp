@@ -0,0 +1,593 @@
+#include "project.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define CHUNK_CELLS (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+#define LEGACY_SIZE (DEFAULT_WORLD_SIZE * DEFAULT_WORLD_SIZE * DEFAULT_WORLD_SIZE)
+
+static const char project_magic[4] = { 'W', 'R', 'L', 'D' };
+
+static void put_u16(std::vector<unsigned char>* out, unsigned int value) {
+    out->push_back(value);
+    out->push_back(value >> 8);
+}
+
+static void put_u32(std::vector<unsigned char>* out, unsigned int value) {
+    put_u16(out, value);
+    put_u16(out, value >> 16);
+}
+
+static void set_u32(std::vector<unsigned char>* out, size_t at, unsigned int value) {
+    for (int i = 0; i < 4; i++) (*out)[at + i] = value >> (i * 8);
+}
+
+static void put_varint(std::vector<unsigned char>* out, unsigned int value) {
+    for (; value >= 0x80; value >>= 7) out->push_back(value | 0x80);
+    out->push_back(value);
+}
+
+// bounds checked, ok turns false on the first read past the end and everything after that reads as 0
+struct Reader {
+    const unsigned char* data;
+    size_t size;
+    size_t pos = 0;
+    bool ok = true;
+
+    Reader(const unsigned char* data, size_t size): data(data), size(size) {}
+    const unsigned char* bytes(size_t count) {
+        if (!ok || count > size - pos) {
+            ok = false;
+            return NULL;
+        }
+        pos += count;
+        return data + pos - count;
+    }
+    unsigned int u8() {
+        const unsigned char* b = bytes(1);
+        return b ? b[0] : 0;
+    }
+    unsigned int u16() {
+        const unsigned char* b = bytes(2);
+        return b ? b[0] | b[1] << 8 : 0;
+    }
+    unsigned int u32() {
+        const unsigned char* b = bytes(4);
+        return b ? b[0] | b[1] << 8 | b[2] << 16 | (unsigned int)b[3] << 24 : 0;
+    }
+    unsigned int varint() {
+        unsigned int value = 0;
+        for (int shift = 0; shift < 32; shift += 7) {
+            unsigned int byte = u8();
+            value |= (byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+};
+
+static bool valid_size(unsigned int width, unsigned int height, unsigned int depth) {
+    return width >= 1 && height >= 1 && depth >= 1 && width <= MAX_WORLD_SIZE && height <= MAX_WORLD_SIZE && depth <= MAX_WORLD_SIZE;
+}
+
+void encode_project(const World& world, std::vector<unsigned char>* out) {
+    IVec3 size  = world.size();
+    IVec3 count = world.chunk_count();
+    std::vector<unsigned char> cells(CHUNK_CELLS);
+    out->assign(project_magic, project_magic + 4);
+    put_u32(out, 0);
+    put_u32(out, PROJECT_VERSION);
+    put_u32(out, size.x);
+    put_u32(out, size.y);
+    put_u32(out, size.z);
+    size_t num_chunks_at = out->size();
+    put_u32(out, 0);
+
+    int num_chunks = 0;
+    for (int cx = 0; cx < count.x; cx++) {
+        for (int cy = 0; cy < count.y; cy++) {
+            for (int cz = 0; cz < count.z; cz++) {
+                if (!world.chunk(cx, cy, cz)) continue;
+                world.get_packed_chunk(cx, cy, cz, cells.data());
+
+                // the palette lists the cell bytes in the order they first show up
+                int slots[256];
+                unsigned char palette[256];
+                int palette_size = 0;
+                memset(slots, -1, sizeof(slots));
+                for (int i = 0; i < CHUNK_CELLS; i++) {
+                    if (slots[cells[i]] >= 0) continue;
+                    slots[cells[i]] = palette_size;
+                    palette[palette_size++] = cells[i];
+                }
+
+                put_u16(out, cx);
+                put_u16(out, cy);
+                put_u16(out, cz);
+                out->push_back(palette_size);
+                out->insert(out->end(), palette, palette + palette_size);
+                size_t runs_at = out->size();
+                put_u32(out, 0);
+                for (int i = 0; i < CHUNK_CELLS;) {
+                    int end = i + 1;
+                    while (end < CHUNK_CELLS && cells[end] == cells[i]) end++;
+                    out->push_back(slots[cells[i]]);
+                    put_varint(out, end - i - 1);
+                    i = end;
+                }
+                set_u32(out, runs_at, out->size() - runs_at - 4);
+                num_chunks++;
+            }
+        }
+    }
+    set_u32(out, num_chunks_at, num_chunks);
+}
+
+// a chunk of a v2 file, found and checked before the world is touched and decoded on the job pool
+struct ChunkRecord {
+    int cx, cy, cz;
+    IVec3 extent; // the part of the chunk inside the world
+    const unsigned char* palette;
+    const unsigned char* runs;
+    unsigned int runs_size;
+    std::shared_ptr<Chunk> chunk;
+};
+
+static bool index_chunks(Reader reader, int num_chunks, IVec3 size, std::vector<ChunkRecord>* out) {
+    IVec3 count = IVec3((size.x + CHUNK_SIZE - 1) / CHUNK_SIZE, (size.y + CHUNK_SIZE - 1) / CHUNK_SIZE, (size.z + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    out->resize(num_chunks);
+    for (int i = 0; i < num_chunks; i++) {
+        ChunkRecord& record = (*out)[i];
+        record.cx = reader.u16();
+        record.cy = reader.u16();
+        record.cz = reader.u16();
+        unsigned int palette_size = reader.u8();
+        record.palette = reader.bytes(palette_size);
+        record.runs_size = reader.u32();
+        record.runs = reader.bytes(record.runs_size);
+        if (!reader.ok || record.cx >= count.x || record.cy >= count.y || record.cz >= count.z) {
+            printf("Project chunk %d is cut off or out of bounds\n", i);
+            return false;
+        }
+        IVec3 first = IVec3(record.cx, record.cy, record.cz) * CHUNK_SIZE;
+        record.extent = IVec3(std::min(size.x - first.x, CHUNK_SIZE), std::min(size.y - first.y, CHUNK_SIZE), std::min(size.z - first.z, CHUNK_SIZE));
+
+        Reader runs(record.runs, record.runs_size);
+        unsigned int filled = 0;
+        while (runs.pos < runs.size) {
+            unsigned int index  = runs.u8();
+            unsigned int length = runs.varint() + 1;
+            if (!runs.ok || index >= palette_size || length > CHUNK_CELLS - filled) {
+                printf("Project chunk %d has a broken run\n", i);
+                return false;
+            }
+            filled += length;
+        }
+        if (filled != CHUNK_CELLS) {
+            printf("Project chunk %d has %u of %d cells\n", i, filled, CHUNK_CELLS);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void decode_chunk(void* data) {
+    ChunkRecord* record = (ChunkRecord*)data;
+    thread_local unsigned char cells[CHUNK_CELLS];
+    Reader runs(record->runs, record->runs_size);
+    for (unsigned int filled = 0; runs.pos < runs.size;) {
+        unsigned char cell = record->palette[runs.u8()];
+        unsigned int length = runs.varint() + 1;
+        memset(cells + filled, cell, length);
+        filled += length;
+    }
+
+    Chunk* chunk = new Chunk();
+    BlockID row[CHUNK_SIZE] = {};
+    for (int x = 0; x < record->extent.x; x++) {
+        for (int y = 0; y < record->extent.y; y++) {
+            const unsigned char* bytes = cells + (x * CHUNK_SIZE + y) * CHUNK_SIZE;
+            unsigned int foreground = 0;
+            for (int z = 0; z < record->extent.z; z++) {
+                row[z] = World::unpack_block(bytes[z]);
+                if (bytes[z] & FOREGROUND_BIT) foreground |= 1u << z;
+            }
+            chunk->set_row(x, y, row, foreground);
+        }
+    }
+    record->chunk.reset(chunk);
+}
+
+// v1 and legacy files, one byte per cell
+static void decode_cells(const unsigned char* cells, IVec3 size, World& world) {
+    world.resize(size.x, size.y, size.z);
+    for (int x = 0; x < size.x; x++) {
+        for (int y = 0; y < size.y; y++) world.set_packed_row(x, y, cells + ((size_t)x * size.y + y) * size.z);
+    }
+}
+
+bool decode_project(const unsigned char* data, size_t size, World& world) {
+    Reader reader(data, size);
+    const unsigned char* magic = reader.bytes(4);
+    if (!magic || memcmp(magic, project_magic, 4) != 0) {
+        if (size != LEGACY_SIZE) {
+            printf("Not a project file\n");
+            return false;
+        }
+        decode_cells(data, IVec3(DEFAULT_WORLD_SIZE, DEFAULT_WORLD_SIZE, DEFAULT_WORLD_SIZE), world);
+        return true;
+    }
+
+    // v1 starts right away with the width, which is never 0
+    unsigned int width = reader.u32();
+    bool versioned = width == 0;
+    unsigned int version = 1;
+    if (versioned) {
+        version = reader.u32();
+        width = reader.u32();
+    }
+    unsigned int height = reader.u32(), depth = reader.u32();
+    if (!reader.ok || !valid_size(width, height, depth)) {
+        printf("Project has an invalid size of %ux%ux%u\n", width, height, depth);
+        return false;
+    }
+    IVec3 dimensions = IVec3(width, height, depth);
+
+    if (!versioned) {
+        const unsigned char* cells = reader.bytes((size_t)width * height * depth);
+        if (!cells) {
+            printf("Project is cut off\n");
+            return false;
+        }
+        decode_cells(cells, dimensions, world);
+        return true;
+    }
+    if (version != PROJECT_VERSION) {
+        printf("Project version %u isn't supported, this build reads up to version %d\n", version, PROJECT_VERSION);
+        return false;
+    }
+
+    int num_chunks = reader.u32();
+    IVec3 count = IVec3((width + CHUNK_SIZE - 1) / CHUNK_SIZE, (height + CHUNK_SIZE - 1) / CHUNK_SIZE, (depth + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    std::vector<ChunkRecord> records;
+    if (!reader.ok || num_chunks < 0 || num_chunks > count.x * count.y * count.z || !index_chunks(reader, num_chunks, dimensions, &records)) {
+        printf("Project data is broken\n");
+        return false;
+    }
+    // the chunks don't depend on each other, they're unpacked on the pool and only handed to the world here
+    JobGroup group;
+    for (ChunkRecord& record : records) push_job(decode_chunk, &record, &group);
+    wait_jobs(&group);
+    world.resize(width, height, depth);
+    for (ChunkRecord& record : records) world.set_chunk(record.cx, record.cy, record.cz, std::move(record.chunk));
+    return true;
+}
+
+bool read_file(const char* filename, std::vector<unsigned char>* out) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) {
+        printf("Could not open %s\n", filename);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out->resize(size > 0 ? size : 0);
+    bool ok = size >= 0 && fread(out->data(), 1, out->size(), f) == out->size();
+    fclose(f);
+    if (!ok) printf("Could not read %s\n", filename);
+    return ok;
+}
+
+bool write_file(const char* filename, const std::vector<unsigned char>& data) {
+    std::string temporary = std::string(filename) + ".tmp";
+    FILE* f = fopen(temporary.c_str(), "wb");
+    if (!f) {
+        printf("Could not write %s\n", temporary.c_str());
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size() && fflush(f) == 0;
+    // on disk before the rename, or a crash right after it could leave an empty file under the real name
+#ifdef WINDOWS
+    ok = ok && _commit(_fileno(f)) == 0;
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    ok = fclose(f) == 0 && ok;
+    std::error_code error;
+    if (ok) std::filesystem::rename(temporary, filename, error);
+    if (!ok || error) {
+        printf("Could not write all of %s\n", filename);
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// the save thread sleeps until start_save hands it a snapshot
+static std::thread save_thread;
+static std::mutex save_lock;
+static std::condition_variable save_wake;
+static bool save_requested = false;
+static bool save_stopping  = false;
+static std::atomic<int> save_status(Save_Idle);
+static World save_snapshot(1, 1, 1);
+static char save_filename[1024];
+static std::vector<unsigned char> save_buffer; // kept between saves, so only the first one grows it
+
+static void save_worker() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(save_lock);
+            save_wake.wait(lock, []() { return save_requested || save_stopping; });
+            if (!save_requested) return;
+            save_requested = false;
+        }
+        encode_project(save_snapshot, &save_buffer);
+        bool ok = write_file(save_filename, save_buffer);
+        save_status.store(ok ? Save_Done : Save_Failed, std::memory_order_release);
+    }
+}
+
+bool start_save(const World& world, const char* filename) {
+    if (save_status.load(std::memory_order_acquire) != Save_Idle) return false;
+    if (strlen(filename) >= sizeof(save_filename)) {
+        printf("Path too long to save to: %s\n", filename);
+        return false;
+    }
+    if (!save_thread.joinable()) save_thread = std::thread(save_worker);
+    // only copies the chunk pointers, the chunks themselves get copied by the world once it edits them
+    world.snapshot(save_snapshot);
+    strcpy(save_filename, filename);
+    save_status.store(Save_Running, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(save_lock);
+        save_requested = true;
+    }
+    save_wake.notify_one();
+    return true;
+}
+
+SaveStatus poll_save() {
+    SaveStatus status = (SaveStatus)save_status.load(std::memory_order_acquire);
+    if (status == Save_Done || status == Save_Failed) {
+        // the snapshot lets go of its chunks on this thread, the one that checks whether they're shared
+        save_snapshot.clear();
+        save_status.store(Save_Idle, std::memory_order_relaxed);
+    }
+    return status;
+}
+
+void stop_saving() {
+    if (!save_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(save_lock);
+        save_stopping = true;
+    }
+    save_wake.notify_one();
+    save_thread.join();
+    save_stopping = false;
+    poll_save();
+}
+
+#define JOURNAL_HEADER 20
+#define JOURNAL_RECORD 5
+
+static const char journal_magic[4] = { 'W', 'R', 'L', 'J' };
+
+static FILE* journal_file = NULL;
+static std::string journal_name;
+static IVec3 journal_dims;
+static bool recording = false;
+static std::vector<unsigned char> journal_buffer; // records that haven't been written yet
+static size_t journal_bytes = 0;
+static size_t compacting_bytes = 0; // in .journal.old, the part the running compaction covers
+
+static bool journal_header(const unsigned char* data, size_t size, IVec3 dims) {
+    Reader reader(data, size);
+    const unsigned char* magic = reader.bytes(4);
+    unsigned int version = reader.u32();
+    int width = reader.u32(), height = reader.u32(), depth = reader.u32();
+    return reader.ok && memcmp(magic, journal_magic, 4) == 0 && version == JOURNAL_VERSION && IVec3(width, height, depth) == dims;
+}
+
+static bool new_journal_file(const std::string& filename, IVec3 dims) {
+    std::vector<unsigned char> header(journal_magic, journal_magic + 4);
+    put_u32(&header, JOURNAL_VERSION);
+    put_u32(&header, dims.x);
+    put_u32(&header, dims.y);
+    put_u32(&header, dims.z);
+    FILE* f = fopen(filename.c_str(), "wb");
+    bool ok = f && fwrite(header.data(), 1, header.size(), f) == header.size();
+    if (f) ok = fclose(f) == 0 && ok;
+    if (!ok) printf("Could not write %s\n", filename.c_str());
+    return ok;
+}
+
+// the record bytes in a journal for a world of this size, a record cut off by a crash gets dropped. -1 when there's no
+// such journal
+static long trim_journal(const std::string& filename, IVec3 dims) {
+    std::error_code error;
+    long size = std::filesystem::file_size(filename, error);
+    if (error) return -1;
+    unsigned char header[JOURNAL_HEADER];
+    FILE* f = fopen(filename.c_str(), "rb");
+    bool ok = f && fread(header, 1, JOURNAL_HEADER, f) == JOURNAL_HEADER && journal_header(header, JOURNAL_HEADER, dims);
+    if (f) fclose(f);
+    if (!ok) return -1;
+    long records = (size - JOURNAL_HEADER) / JOURNAL_RECORD * JOURNAL_RECORD;
+    if (records != size - JOURNAL_HEADER) std::filesystem::resize_file(filename, JOURNAL_HEADER + records, error);
+    return error ? -1 : records;
+}
+
+// records held back by hold_journal go to the new journal
+static bool open_journal(const char* project, IVec3 size, bool append) {
+    flush_journal(false);
+    if (journal_file) fclose(journal_file);
+    journal_file = NULL;
+    journal_name = std::string(project) + ".journal";
+    journal_dims = size;
+    journal_bytes = 0;
+    long records = append ? trim_journal(journal_name, size) : -1;
+    if (records < 0 && !new_journal_file(journal_name, size)) return false;
+    if (records > 0) journal_bytes += records;
+    if (append) {
+        long old_records = trim_journal(journal_name + ".old", size);
+        if (old_records > 0) journal_bytes += old_records;
+    }
+    journal_file = fopen(journal_name.c_str(), "ab");
+    if (!journal_file) {
+        printf("Could not open %s\n", journal_name.c_str());
+        return false;
+    }
+    recording = true;
+    return flush_journal(false);
+}
+
+bool create_journal(const char* project, IVec3 size) {
+    remove((std::string(project) + ".journal.old").c_str());
+    return open_journal(project, size, false);
+}
+
+bool append_journal(const char* project, IVec3 size) {
+    return open_journal(project, size, true);
+}
+
+void remove_journals(const char* project) {
+    std::string filename = std::string(project) + ".journal";
+    remove(filename.c_str());
+    remove((filename + ".old").c_str());
+}
+
+void close_journal() {
+    flush_journal(false);
+    if (journal_file) fclose(journal_file);
+    journal_file = NULL;
+    recording = false;
+    journal_buffer.clear();
+}
+
+void hold_journal() {
+    flush_journal(false);
+    if (journal_file) fclose(journal_file);
+    journal_file = NULL;
+    recording = true;
+}
+
+bool journaling() {
+    return recording;
+}
+
+void journal_cell(const World& world, int x, int y, int z) {
+    if (!recording || !world.in_bounds(x, y, z)) return;
+    put_u32(&journal_buffer, x | y << 10 | z << 20);
+    journal_buffer.push_back(world.packed(x, y, z));
+}
+
+bool flush_journal(bool sync) {
+    if (!journal_file) return true;
+    bool ok = true;
+    if (!journal_buffer.empty()) {
+        ok = fwrite(journal_buffer.data(), 1, journal_buffer.size(), journal_file) == journal_buffer.size() && fflush(journal_file) == 0;
+        journal_bytes += journal_buffer.size();
+        journal_buffer.clear();
+    }
+#ifdef WINDOWS
+    if (sync) ok = ok && _commit(_fileno(journal_file)) == 0;
+#else
+    if (sync) ok = ok && fsync(fileno(journal_file)) == 0;
+#endif
+    if (!ok) {
+        printf("Could not write %s, edits aren't journaled anymore\n", journal_name.c_str());
+        close_journal();
+    }
+    return ok;
+}
+
+size_t journal_size() {
+    return journal_bytes;
+}
+
+void start_compacting() {
+    compacting_bytes = 0;
+    if (!journal_file) return;
+    flush_journal(false);
+    fclose(journal_file);
+    journal_file = NULL;
+
+    // what's left of a compaction that never finished stays, the journal goes after it
+    std::string old_name = journal_name + ".old";
+    bool moved;
+    if (trim_journal(old_name, journal_dims) < 0) {
+        std::error_code error;
+        std::filesystem::rename(journal_name, old_name, error);
+        moved = !error;
+    }
+    else {
+        std::vector<unsigned char> data;
+        FILE* f = read_file(journal_name.c_str(), &data) ? fopen(old_name.c_str(), "ab") : NULL;
+        size_t records = data.size() > JOURNAL_HEADER ? data.size() - JOURNAL_HEADER : 0;
+        moved = f && fwrite(data.data() + JOURNAL_HEADER, 1, records, f) == records;
+        if (f) moved = fclose(f) == 0 && moved;
+    }
+    if (!moved) {
+        // the journal stays where it is, nothing's lost and the next compaction tries again
+        printf("Could not move %s aside\n", journal_name.c_str());
+        journal_file = fopen(journal_name.c_str(), "ab");
+        recording = journal_file != NULL;
+        return;
+    }
+    compacting_bytes = journal_bytes;
+    journal_file = new_journal_file(journal_name, journal_dims) ? fopen(journal_name.c_str(), "ab") : NULL;
+    recording = journal_file != NULL;
+}
+
+void finish_compacting(bool saved) {
+    if (!saved || journal_name.empty()) return;
+    remove((journal_name + ".old").c_str());
+    journal_bytes -= compacting_bytes < journal_bytes ? compacting_bytes : journal_bytes;
+    compacting_bytes = 0;
+}
+
+static int replay_journal(const std::string& filename, World& world) {
+    std::error_code error;
+    if (!std::filesystem::exists(filename, error)) return 0;
+    std::vector<unsigned char> data;
+    if (!read_file(filename.c_str(), &data)) return 0;
+    if (!journal_header(data.data(), data.size(), world.size())) {
+        printf("Ignoring %s, it isn't a journal for this project\n", filename.c_str());
+        return 0;
+    }
+    int replayed = 0;
+    for (size_t i = JOURNAL_HEADER; i + JOURNAL_RECORD <= data.size(); i += JOURNAL_RECORD) {
+        unsigned int position = data[i] | data[i + 1] << 8 | data[i + 2] << 16 | (unsigned int)data[i + 3] << 24;
+        int x = position & 1023, y = position >> 10 & 1023, z = position >> 20 & 1023;
+        if (!world.in_bounds(x, y, z)) continue;
+        world.set_packed(x, y, z, data[i + 4]);
+        replayed++;
+    }
+    return replayed;
+}
+
+bool replay_journals(const char* project, World& world) {
+    std::string filename = std::string(project) + ".journal";
+    int replayed = replay_journal(filename + ".old", world) + replay_journal(filename, world);
+    if (replayed > 0) printf("Replayed %d edits from the journal of %s\n", replayed, project);
+    return replayed > 0;
+}
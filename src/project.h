@@ -0,0 +1,67 @@
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include "world.h"
+
+#include <stddef.h>
+
+#include <vector>
+
+// .wrl project files, all numbers are little endian
+//  v2:     "WRLD", a u32 0 where v1 has its width, u32 version, u32 width, height, depth and u32 chunk count, then for
+//          every chunk with something in it: u16 cx, cy, cz, u8 palette size and the palette's cell bytes, u32 size
+//          of the runs and the runs themselves, a u8 palette index and a varint length - 1, over the chunk in x, y, z order
+//  v1:     "WRLD", u32 width, height, depth and one byte per cell in x, y, z order
+//  legacy: 32x32x32 cell bytes without a header
+// a cell byte is its BlockID, with FOREGROUND_BIT set when it's in the foreground
+#define PROJECT_VERSION 2
+
+void encode_project(const World& world, std::vector<unsigned char>* out);
+// leaves the world untouched and prints why when the data isn't a valid project
+bool decode_project(const unsigned char* data, size_t size, World& world);
+
+// the whole file in one read or write, they print what went wrong. write_file writes next to the
+// file first and renames over it, so a failed save never leaves half a project behind
+bool read_file(const char* filename, std::vector<unsigned char>* out);
+bool write_file(const char* filename, const std::vector<unsigned char>& data);
+
+enum SaveStatus {
+    Save_Idle,
+    Save_Running,
+    Save_Done,   // reported by poll_save once, it's idle again after that
+    Save_Failed, // the same
+};
+
+// encodes and writes a snapshot of the world on the save thread, the world can be edited right away.
+// false when the last save is still running
+bool start_save(const World& world, const char* filename);
+SaveStatus poll_save();
+void stop_saving(); // waits for a running save
+
+// edit journal, <project>.journal: "WRLJ", u32 version, u32 width, height and depth, then 5 bytes for every cell write,
+// a u32 with x | y << 10 | z << 20 and the cell byte it was set to. records hold values rather than changes, so
+// replaying them over a base that already has some of them still ends up at the same world. compacting moves the
+// journal to <project>.journal.old while the base is rewritten and removes it once the base is on disk
+#define JOURNAL_VERSION 1
+
+// starts an empty journal for a freshly saved project
+bool create_journal(const char* project, IVec3 size);
+// keeps appending to the journal the project was opened with, or starts one
+bool append_journal(const char* project, IVec3 size);
+void remove_journals(const char* project);
+void close_journal(); // flushes first
+// closes the journal but keeps the records coming in, until create_journal or append_journal gets them
+void hold_journal();
+bool journaling();
+// buffers the cell as it is now, does nothing without a journal
+void journal_cell(const World& world, int x, int y, int z);
+// hands the buffered records to the system, with sync they're on disk when it returns. when writing fails the
+// journal is closed
+bool flush_journal(bool sync);
+size_t journal_size(); // record bytes since the base was last written
+void start_compacting();
+void finish_compacting(bool saved);
+// replays .journal.old and .journal over the base that was just opened, false when there were none
+bool replay_journals(const char* project, World& world);
+
+#endif
\ No newline at end of file
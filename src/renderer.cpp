@@ -1,76 +1,33 @@
 #include "renderer.h"
+#include "block_info.h"
+#include "alloc_count.h"
+#include "jobs.h"
 
-#include <GL/gl.h>
+#include <GL/glew.h>
+#include <SDL3/SDL.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <string.h>
 
+#include <atomic>
 #include <vector>
 
 #include "lib/stb_image.h"
 
 #define SCALE 6
+#define WATER_FRAME_MS 250
+#define PULSE_FRAME_MS 33
+#define MATRIX_STACK_SIZE 16
+#define MESH_JOB_COUNT 32 // chunks being meshed on the job threads at once
+#define MESH_POLL_MS 4
 
 static int num_frames = 0;
 
-template<typename T> void swap(T& a, T& b) {
-    T temp = a;
-    a = b;
-    b = temp;
-}
-
-enum Flip {
-    Flip_None,
-    Flip_XAxis,
-    Flip_YAxis
-};
-
-enum Rotation {
-    deg0,
-    deg90,
-    deg180,
-    deg270
-};
-
 struct Vertex {
     Vec3 xyz;
     Vec2 uv;
-};
-
-struct Texture {
-    IVec4 src;
-    Flip flip;
-    Rotation rot;
-
-    Vec2 uv[4];
-
-    Texture(IVec4 src = IVec4(), Rotation rot = deg0, Flip flip = Flip_None): src(src), flip(flip), rot(rot) {
-        Vec4 vec = Vec4(
-            (src.x        ) / (float)TILEMAP_WIDTH,
-            (src.y        ) / (float)TILEMAP_HEIGHT,
-            (src.x + src.z) / (float)TILEMAP_WIDTH,
-            (src.y + src.w) / (float)TILEMAP_HEIGHT
-        );
-        uv[0] = Vec2(vec.z, vec.w);
-        uv[1] = Vec2(vec.x, vec.w);
-        uv[2] = Vec2(vec.x, vec.y);
-        uv[3] = Vec2(vec.z, vec.y);
-
-        switch (flip) {
-            case Flip_None: break;
-            case Flip_XAxis:
-                swap(uv[2], uv[3]);
-                swap(uv[0], uv[1]);
-                break;
-            case Flip_YAxis:
-                swap(uv[1], uv[2]);
-                swap(uv[0], uv[3]);
-                break;
-        }
-        for (int i = 0; i < rot; i++) {
-            swap(uv[2], uv[3]);
-            swap(uv[1], uv[2]);
-            swap(uv[0], uv[1]);
-        }
-    }
+    Vec4 rect;  // tileset area the uv wraps around in, so merged faces can repeat their tile
+    float anim; // 1 if the rect moves down by its height every animation frame
 };
 
 struct {
@@ -78,23 +35,247 @@ struct {
     Vec3 rot = Vec3(-25, 180+45, 0);
 } camera;
 
+struct ChunkMesh {
+    unsigned int version = 0;
+    int faces = 0;
+    GLuint vbo = 0;
+    int num_vertices = 0;
+    int quads_culled = 0;
+    int quads_merged = 0;
+    bool animated = false;
+    Vec3 from, to; // bounds of the vertices, tested against the view volume before drawing
+    // the newest job queued for the chunk, the mesh above stays until a result newer than ticket comes back
+    unsigned int ticket = 0;
+    unsigned int queued_version = 0;
+    int queued_faces = 0;
+};
+
+// one per WorldContext, chunks are meshed and rebuilt on their own
+struct VoxelMesh {
+    const World* world = NULL;
+    IVec3 chunk_count;
+    std::vector<ChunkMesh> chunks;
+    unsigned int generation = 0; // bumped on reset, results of jobs queued before are dropped
+};
+
+// everything meshing a chunk reads, copied out of the world so the job threads never see it while it's edited
+struct ChunkSource {
+    Chunk chunk;
+    // packed cells just across each face, in face_normals order and indexed by the other two axes in x, y, z order
+    unsigned char border[6][CHUNK_SIZE][CHUNK_SIZE];
+    int base[3];
+};
+
+enum MeshJobState {
+    MeshJob_Free,
+    MeshJob_Queued,
+    MeshJob_Done,
+};
+
+struct MeshJob {
+    std::atomic<int> state = { MeshJob_Free };
+    ChunkSource source;
+    WorldContext context;
+    int faces;
+    // where the result goes
+    unsigned int generation;
+    int index;
+    unsigned int version;
+    unsigned int ticket;
+    // filled in on the job thread
+    std::vector<Vertex> vertices;
+    RenderStats stats;
+    bool animated;
+    Vec3 from, to;
+};
+
+// the grid and both voxel contexts rendered offscreen, redrawn only when something it depends on changes
+struct WorldLayer {
+    GLuint framebuffer = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+    int width = 0;
+    int height = 0;
+    bool valid = false;
+
+    const World* world = NULL;
+    unsigned int version = 0;
+    unsigned int mesh_version = 0;
+    unsigned int tileset_version = 0;
+    unsigned int view_version = 0;
+    int anim_frame = -1;
+    bool dim_background = false;
+};
+
 Mtx mtx_projection = Mtx::identity();
 Mtx mtx_modelview  = Mtx::identity();
-std::vector<Mtx> matrices = {};
+FixedStack<Mtx, MATRIX_STACK_SIZE> matrices;
 GLuint tileset_texture;
+unsigned int tileset_version = 0;
+unsigned int view_version = 0;
+
+static VoxelMesh voxel_meshes[2]; // one per WorldContext
+static MeshJob mesh_jobs[MESH_JOB_COUNT];
+static JobGroup mesh_group;
+static unsigned int mesh_tickets = 0;
+static unsigned int mesh_version = 0; // bumped whenever a chunk mesh changes
+static int camera_faces = Face_All; // faces that can point towards the camera, the others are never emitted
+static const int face_normals[6][3] = { { 0, 1, 0 }, { 0, -1, 0 }, { 1, 0, 0 }, { -1, 0, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+static const int face_axes[6] = { 1, 1, 0, 0, 2, 2 };
+// the state draw_block and put_vertex work with, per thread so chunks can be meshed on the job threads
+static thread_local std::vector<Vertex>* mesh_target = NULL;
+static thread_local int visible_faces = Face_All;
+static thread_local Vec2 face_repeat = Vec2(1, 1);
+static thread_local bool face_animated = false;
+static thread_local bool animated_vertices = false;
+static GLuint voxel_program = 0;
+static GLuint composite_program = 0;
+static WorldLayer world_layer;
+
+static const char* voxel_vertex_shader =
+    "#version 120\n"
+    "attribute vec3 position;\n"
+    "attribute vec2 uv;\n"
+    "attribute vec4 rect;\n"
+    "attribute float anim;\n"
+    "uniform float anim_frame;\n"
+    "varying vec2 v_uv;\n"
+    "varying vec4 v_rect;\n"
+    "void main() {\n"
+    "    vec2 offset = vec2(0.0, anim * anim_frame * rect.w);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, 1.0);\n"
+    "    gl_FrontColor = gl_Color;\n"
+    "    v_uv = uv + offset;\n"
+    "    v_rect = vec4(rect.xy + offset, rect.zw);\n"
+    "}\n";
+
+static const char* voxel_fragment_shader =
+    "#version 120\n"
+    "uniform sampler2D tileset;\n"
+    "varying vec2 v_uv;\n"
+    "varying vec4 v_rect;\n"
+    "void main() {\n"
+    "    vec2 tile = fract((v_uv - v_rect.xy) / v_rect.zw);\n"
+    "    gl_FragColor = texture2D(tileset, v_rect.xy + tile * v_rect.zw) * gl_Color;\n"
+    "}\n";
+
+static const char* composite_vertex_shader =
+    "#version 120\n"
+    "varying vec2 v_uv;\n"
+    "void main() {\n"
+    "    gl_Position = gl_Vertex;\n"
+    "    v_uv = gl_Vertex.xy * 0.5 + 0.5;\n"
+    "}\n";
+
+static const char* composite_fragment_shader =
+    "#version 120\n"
+    "uniform sampler2D color;\n"
+    "uniform sampler2D depth;\n"
+    "varying vec2 v_uv;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(color, v_uv);\n"
+    "    gl_FragDepth = texture2D(depth, v_uv).r;\n"
+    "}\n";
+
+GLuint compile_shader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint ok;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("shader compilation failed: %s\n", log);
+    }
+    return shader;
+}
+
+GLuint create_program(const char* vertex, const char* fragment, const char** attributes, int num_attributes) {
+    GLuint program = glCreateProgram();
+    glAttachShader(program, compile_shader(GL_VERTEX_SHADER,   vertex));
+    glAttachShader(program, compile_shader(GL_FRAGMENT_SHADER, fragment));
+    for (int i = 0; i < num_attributes; i++) glBindAttribLocation(program, i, attributes[i]);
+    glLinkProgram(program);
+    GLint ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        printf("shader linking failed: %s\n", log);
+    }
+    return program;
+}
+
+void load_matrices() {
+    // gl transforms the vertices, we only upload the combined matrix once per draw
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf((mtx_projection * matrices.back()).data());
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
 
 void push_matrix(Mtx mtx) {
-    matrices.push_back(matrices.back() * mtx);
+    matrices.push(matrices.back() * mtx);
+    load_matrices();
 }
 
 void pop_matrix() {
-    matrices.pop_back();
+    matrices.pop();
+    load_matrices();
 }
 
-void put_vertex(float x, float y, float z, float u = 0, float v = 0) {
-    Vec3 vec = (mtx_projection * matrices.back() * Vec4(x, y, z, 1)).divide().vec3();
+void put_vertex(float x, float y, float z, float u = 0, float v = 0, Vec4 rect = Vec4()) {
+    if (mesh_target) {
+        Vertex vertex;
+        vertex.xyz  = Vec3(x, y, z);
+        vertex.uv   = Vec2(u, v);
+        vertex.rect = rect;
+        vertex.anim = face_animated;
+        animated_vertices |= face_animated;
+        mesh_target->push_back(vertex);
+        return;
+    }
     glTexCoord2f(u, v);
-    glVertex3f(vec.x, vec.y, vec.z);
+    glVertex3f(x, y, z);
+}
+
+int current_anim_frame() {
+    return (SDL_GetTicks() / WATER_FRAME_MS) % 4;
+}
+
+bool voxels_animated() {
+    for (VoxelMesh& mesh : voxel_meshes) {
+        for (ChunkMesh& chunk : mesh.chunks) {
+            if (chunk.animated) return true;
+        }
+    }
+    return false;
+}
+
+bool mesh_jobs_pending() {
+    for (MeshJob& job : mesh_jobs) {
+        if (job.state.load(std::memory_order_acquire) != MeshJob_Free) return true;
+    }
+    return false;
+}
+
+int redraw_timeout(bool selection_visible) {
+    int timeout = selection_visible ? PULSE_FRAME_MS : -1;
+    if (voxels_animated()) {
+        int water = WATER_FRAME_MS - SDL_GetTicks() % WATER_FRAME_MS;
+        if (timeout < 0 || water < timeout) timeout = water;
+    }
+    // chunks still being meshed are picked up by the next frame
+    if (mesh_jobs_pending() && (timeout < 0 || MESH_POLL_MS < timeout)) timeout = MESH_POLL_MS;
+    return timeout;
+}
+
+void pan_camera(float right, float forward) {
+    // along the ground, the camera's axes with their height dropped
+    Vec3 x = Vec3( mtx_modelview[0][0], 0,  mtx_modelview[0][2]).normalized();
+    Vec3 z = Vec3(-mtx_modelview[2][0], 0, -mtx_modelview[2][2]).normalized();
+    camera.pos += x * right + z * forward;
 }
 
 void unproject(float x, float y, Vec3* pos, Vec3* dir) {
@@ -112,7 +293,27 @@ void render_end() {
     glFlush();
 }
 
-void prepare_rendering(float near_plane) {
+static Mtx camera_modelview() {
+    return Mtx::identity()
+        * Mtx::roll (-camera.rot.z * Angle::rad)
+        * Mtx::pitch(-camera.rot.x * Angle::rad)
+        * Mtx::yaw  (-camera.rot.y * Angle::rad)
+        * Mtx::translate(-camera.pos)
+    ;
+}
+
+float view_depth(const World& world) {
+    Mtx mtx = camera_modelview();
+    IVec3 size = world.size();
+    float depth = 0;
+    for (int i = 0; i < 8; i++) {
+        Vec4 corner = mtx * Vec4(i & 1 ? size.x : 0, i & 2 ? size.y : 0, i & 4 ? size.z : 0, 1);
+        if (-corner.z > depth) depth = -corner.z;
+    }
+    return depth;
+}
+
+void prepare_rendering(const World& world, float near_plane) {
     if (num_frames == 0) {
         int x, y, c;
         unsigned char* image = stbi_load("../assets/images/tilesets/grass_map_tileset.png", &x, &y, &c, 4);
@@ -124,6 +325,10 @@ void prepare_rendering(float near_plane) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TILEMAP_WIDTH, TILEMAP_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
         stbi_image_free(image);
+
+        const char* attributes[] = { "position", "uv", "rect", "anim" };
+        voxel_program = create_program(voxel_vertex_shader, voxel_fragment_shader, attributes, 4);
+        composite_program = create_program(composite_vertex_shader, composite_fragment_shader, NULL, 0);
     }
 
     glClearColor(0.f, 0.f, 0.f, 1.f);
@@ -138,140 +343,633 @@ void prepare_rendering(float near_plane) {
     glAlphaFunc(GL_GREATER, .01f);
 
     //mtx_projection = Mtx::perspective(70, 3/2.f, .1f, 100.f);
-    mtx_projection = Mtx::orthographic(-SCALE, SCALE, -SCALE * 2/3.f, SCALE * 2/3.f, near_plane, 100.f);
-    mtx_modelview = Mtx::identity()
-        * Mtx::roll (-camera.rot.z * Angle::rad)
-        * Mtx::pitch(-camera.rot.x * Angle::rad)
-        * Mtx::yaw  (-camera.rot.y * Angle::rad)
-        * Mtx::translate(-camera.pos)
-    ;
+    // the far plane sits just behind the world, so it isn't clipped however large it is
+    mtx_projection = Mtx::orthographic(-SCALE, SCALE, -SCALE * 2/3.f, SCALE * 2/3.f, near_plane, view_depth(world) + 1.f);
+    mtx_modelview = camera_modelview();
+
+    // compared against the matrices of the last frame, the block menu changes mtx_projection in between
+    static Mtx last_projection = Mtx::identity();
+    static Mtx last_modelview  = Mtx::identity();
+    if (memcmp(last_projection.data(), mtx_projection.data(), sizeof(float) * 16) != 0 || memcmp(last_modelview.data(), mtx_modelview.data(), sizeof(float) * 16) != 0) {
+        last_projection = mtx_projection;
+        last_modelview  = mtx_modelview;
+        view_version++;
+    }
 
     matrices.clear();
-    matrices.push_back(mtx_modelview);
+    matrices.push(mtx_modelview);
+    load_matrices();
+
+    // the view is orthographic, so a face is visible when its normal has a positive z in view space
+    camera_faces = 0;
+    for (int i = 0; i < 6; i++) {
+        float z = mtx_modelview[2][0] * face_normals[i][0] + mtx_modelview[2][1] * face_normals[i][1] + mtx_modelview[2][2] * face_normals[i][2];
+        if (z > 0) camera_faces |= 1 << i;
+    }
 
     num_frames++;
 }
 
-void draw_grid() {
+void draw_grid(const World& world) {
+    IVec3 size = world.size();
     glColor4f(.5f, .5f, .5f, 1.f);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    render_begin();
-    for (int x = 0; x < WORLD_SIZE; x++) {
-        for (int z = 0; z < WORLD_SIZE; z++) {
-            put_vertex(x + 0, 0, z + 0);
-            put_vertex(x + 1, 0, z + 0);
-            put_vertex(x + 1, 0, z + 1);
-            put_vertex(x + 0, 0, z + 1);
-        }
+    // one line per row and column instead of a quad per cell, big worlds have a lot of cells
+    glBegin(GL_LINES);
+    for (int x = 0; x <= size.x; x++) {
+        put_vertex(x, 0, 0);
+        put_vertex(x, 0, size.z);
+    }
+    for (int z = 0; z <= size.z; z++) {
+        put_vertex(0,      0, z);
+        put_vertex(size.x, 0, z);
     }
     render_end();
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
-#define SLICE(x) x, x
-#define SIDES(x) x, x, x, x
-#define FACES(x) x, x, x, x, x, x
+// uv of a texture corner stretched so the tile repeats face_repeat times across the quad,
+// u_along_a tells whether the texture's u axis runs along the quad's first axis
+Vec2 tile_uv(const Texture& tex, int corner, bool u_along_a) {
+    if (face_repeat == Vec2::one()) return tex.uv[corner];
+    Vec2 origin = Vec2(tex.rect.x, tex.rect.y);
+    Vec2 scale  = u_along_a ? face_repeat : Vec2(face_repeat.y, face_repeat.x);
+    Vec2 uv = tex.uv[corner] - origin;
+    return origin + Vec2(uv.x * scale.x, uv.y * scale.y);
+}
+
+// emits a quad, reversing the winding when it was given clockwise as seen from the side it faces
+void put_quad(const Vec3* pos, const Vec2* uv, Vec4 rect, bool reverse) {
+    for (int i = 0; i < 4; i++) {
+        int v = reverse ? (4 - i) % 4 : i;
+        put_vertex(pos[v].x, pos[v].y, pos[v].z, uv[v].x, uv[v].y, rect);
+    }
+}
 
-void draw_xplane(Vec2 from, Vec2 to, float x, Texture tex = Texture()) {
-    put_vertex(x, from.x, from.y, tex.uv[1].x, tex.uv[1].y);
-    put_vertex(x,  to .x, from.y, tex.uv[2].x, tex.uv[2].y);
-    put_vertex(x,  to .x,  to .y, tex.uv[3].x, tex.uv[3].y);
-    put_vertex(x, from.x,  to .y, tex.uv[0].x, tex.uv[0].y);
+void draw_xplane(Vec2 from, Vec2 to, float x, bool positive, Texture tex = Texture()) {
+    bool u_along_a = tex.uv[1].x != tex.uv[2].x;
+    Vec3 pos[4] = { Vec3(x, from.x, from.y), Vec3(x, to.x, from.y), Vec3(x, to.x, to.y), Vec3(x, from.x, to.y) };
+    Vec2 uv[4]  = { tile_uv(tex, 1, u_along_a), tile_uv(tex, 2, u_along_a), tile_uv(tex, 3, u_along_a), tile_uv(tex, 0, u_along_a) };
+    put_quad(pos, uv, tex.rect, !positive);
 }
 
-void draw_yplane(Vec2 from, Vec2 to, float y, Texture tex = Texture()) {
-    put_vertex(from.x, y, from.y, tex.uv[0].x, tex.uv[0].y);
-    put_vertex( to .x, y, from.y, tex.uv[1].x, tex.uv[1].y);
-    put_vertex( to .x, y,  to .y, tex.uv[2].x, tex.uv[2].y);
-    put_vertex(from.x, y,  to .y, tex.uv[3].x, tex.uv[3].y);
+void draw_yplane(Vec2 from, Vec2 to, float y, bool positive, Texture tex = Texture()) {
+    bool u_along_a = tex.uv[0].x != tex.uv[1].x;
+    Vec3 pos[4] = { Vec3(from.x, y, from.y), Vec3(to.x, y, from.y), Vec3(to.x, y, to.y), Vec3(from.x, y, to.y) };
+    Vec2 uv[4]  = { tile_uv(tex, 0, u_along_a), tile_uv(tex, 1, u_along_a), tile_uv(tex, 2, u_along_a), tile_uv(tex, 3, u_along_a) };
+    put_quad(pos, uv, tex.rect, positive);
 }
 
-void draw_zplane(Vec2 from, Vec2 to, float z, Texture tex = Texture()) {
-    put_vertex(from.x, from.y, z, tex.uv[0].x, tex.uv[0].y);
-    put_vertex( to .x, from.y, z, tex.uv[1].x, tex.uv[1].y);
-    put_vertex( to .x,  to .y, z, tex.uv[2].x, tex.uv[2].y);
-    put_vertex(from.x,  to .y, z, tex.uv[3].x, tex.uv[3].y);
+void draw_zplane(Vec2 from, Vec2 to, float z, bool positive, Texture tex = Texture()) {
+    bool u_along_a = tex.uv[0].x != tex.uv[1].x;
+    Vec3 pos[4] = { Vec3(from.x, from.y, z), Vec3(to.x, from.y, z), Vec3(to.x, to.y, z), Vec3(from.x, to.y, z) };
+    Vec2 uv[4]  = { tile_uv(tex, 0, u_along_a), tile_uv(tex, 1, u_along_a), tile_uv(tex, 2, u_along_a), tile_uv(tex, 3, u_along_a) };
+    put_quad(pos, uv, tex.rect, !positive);
 }
 
 void draw_box(Vec3 from, Vec3 to, Texture posy = Texture(), Texture negy = Texture(), Texture posx = Texture(), Texture negx = Texture(), Texture posz = Texture(), Texture negz = Texture()) {
-    draw_xplane(Vec2(from.y, from.z), Vec2(to.y, to.z), from.x, negx);
-    draw_xplane(Vec2(from.y, from.z), Vec2(to.y, to.z),  to .x, posx);
-    draw_yplane(Vec2(from.x, from.z), Vec2(to.x, to.z), from.y, negy);
-    draw_yplane(Vec2(from.x, from.z), Vec2(to.x, to.z),  to .y, posy);
-    draw_zplane(Vec2(from.x, from.y), Vec2(to.x, to.y), from.z, negz);
-    draw_zplane(Vec2(from.x, from.y), Vec2(to.x, to.y),  to .z, posz);
-}
-
-void draw_cube(Texture posy = Texture(), Texture negy = Texture(), Texture posx = Texture(), Texture negx = Texture(), Texture posz = Texture(), Texture negz = Texture()) {
-    draw_box(Vec3(0, 0, 0), Vec3(1, 1, 1), posy, negy, posx, negx, posz, negz);
-}
-
-void draw_block(int block, int anim_frame = -1) {
-    if (anim_frame == -1) anim_frame = (num_frames / 25) % 4;
-    switch (block) {
-        case Block_Air: break;
-        case Block_Dirt:          draw_cube(FACES(IVec4(32, 0, 16, 16))); break;
-        case Block_DirtWall:      draw_cube(SLICE(IVec4(32, 0, 16, 16)), SIDES(IVec4(48, 0, 16, 16))); break;
-        case Block_Ground:        draw_cube(IVec4(0, 0, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_PathStraight1: draw_cube(IVec4(32, 16, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_PathStraight2: draw_cube(IVec4(32, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_PathCurved1:   draw_cube(IVec4(0, 16, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_PathCurved2:   draw_cube(IVec4(16, 16, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_PathCurved3:   draw_cube(IVec4(0, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_PathCurved4:   draw_cube(IVec4(16, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_Intersection:  draw_cube(IVec4(48, 32, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_Level:         draw_cube(IVec4(48, 48, 16, 16), IVec4(32, 0, 16, 16), SIDES(IVec4(16, 0, 16, 16))); break;
-        case Block_Bridge1: draw_box(Vec3(0, 0.5, 0), Vec3(1, 1, 1), SLICE(Texture(IVec4(0, 48, 16, 16), deg90)), SLICE(IVec4(16, 48, 16, 8)), SLICE(IVec4(16, 56, 16, 8))); break;
-        case Block_Bridge2: draw_box(Vec3(0, 0.5, 0), Vec3(1, 1, 1), SLICE(Texture(IVec4(0, 48, 16, 16), deg0 )), SLICE(IVec4(16, 56, 16, 8)), SLICE(IVec4(16, 48, 16, 8))); break;
-        case Block_Water:
-            draw_yplane(Vec2(0, 0), Vec2(1, 1), 0, IVec4(48, 16, 16, 16));
-            draw_yplane(Vec2(0, 0), Vec2(1, 1), 0.125, IVec4(64, anim_frame * 16, 16, 16));
-            break;
-        default: break;
-    }
-}
-
-void draw_voxels(World world, WorldContext context, int anim_frame) {
-    glEnable(GL_TEXTURE_2D);
-    glActiveTexture(GL_TEXTURE0);
-    render_begin();
-    for (int x = 0; x < WORLD_SIZE; x++) {
-        for (int y = 0; y < WORLD_SIZE; y++) {
-            for (int z = 0; z < WORLD_SIZE; z++) {
-                bool foreground = world[x][y][z] & 0xF0;
-                if (world[x][y][z] == Block_Air) continue;
-                if ((context == BackgroundOnly && foreground) || (context == ForegroundOnly && !foreground)) continue;
-                push_matrix(Mtx::translate(x, y, z));
-                draw_block(world[x][y][z] & 0x7F, anim_frame);
-                pop_matrix();
+    if (visible_faces & Face_NegX) draw_xplane(Vec2(from.y, from.z), Vec2(to.y, to.z), from.x, false, negx);
+    if (visible_faces & Face_PosX) draw_xplane(Vec2(from.y, from.z), Vec2(to.y, to.z),  to .x, true,  posx);
+    if (visible_faces & Face_NegY) draw_yplane(Vec2(from.x, from.z), Vec2(to.x, to.z), from.y, false, negy);
+    if (visible_faces & Face_PosY) draw_yplane(Vec2(from.x, from.z), Vec2(to.x, to.z),  to .y, true,  posy);
+    if (visible_faces & Face_NegZ) draw_zplane(Vec2(from.x, from.y), Vec2(to.x, to.y), from.z, false, negz);
+    if (visible_faces & Face_PosZ) draw_zplane(Vec2(from.x, from.y), Vec2(to.x, to.y),  to .z, true,  posz);
+}
+
+void draw_cube(Vec3 pos, Texture posy = Texture(), Texture negy = Texture(), Texture posx = Texture(), Texture negx = Texture(), Texture posz = Texture(), Texture negz = Texture()) {
+    draw_box(pos, pos + Vec3(1, 1, 1), posy, negy, posx, negx, posz, negz);
+}
+
+bool is_opaque_cube(unsigned char block) {
+    int flags = block_info[block].flags;
+    return (flags & BlockFlag_Opaque) && (flags & BlockFlag_FullCube);
+}
+
+void draw_block(int block, Vec3 pos, int anim_frame = -1) {
+    if (anim_frame == -1) anim_frame = current_anim_frame();
+    const BlockInfo& info = block_info[block];
+    const Texture* faces = info.faces;
+    if (!(info.flags & BlockFlag_Liquid)) {
+        draw_box(pos + info.from, pos + info.to, faces[0], faces[1], faces[2], faces[3], faces[4], faces[5]);
+        return;
+    }
+
+    if (!(visible_faces & Face_PosY)) return;
+    Texture surface = faces[0];
+    // meshes leave the animation to the shader, immediate drawing has to pick the frame here
+    if (mesh_target) face_animated = info.flags & BlockFlag_Animated;
+    else if (info.flags & BlockFlag_Animated) surface = Texture(IVec4(surface.src.x, surface.src.y + anim_frame * surface.src.w, surface.src.z, surface.src.w), surface.rot, surface.flip);
+    draw_yplane(Vec2(pos.x + info.from.x, pos.z + info.from.z), Vec2(pos.x + info.to.x, pos.z + info.to.z), pos.y + info.from.y, true, faces[1]);
+    draw_yplane(Vec2(pos.x + info.from.x, pos.z + info.from.z), Vec2(pos.x + info.to.x, pos.z + info.to.z), pos.y + info.to.y,   true, surface);
+    face_animated = false;
+}
+
+// x, y and z are local to the chunk, neighbours across its border are looked up in the copied border cells
+int exposed_faces(const ChunkSource& source, int faces, int x, int y, int z) {
+    const Chunk* chunk = &source.chunk;
+    bool foreground = chunk->is_foreground(x, y, z);
+    int exposed = 0;
+    for (int i = 0; i < 6; i++) {
+        if (!(faces & (1 << i))) continue;
+        int nx = x + face_normals[i][0];
+        int ny = y + face_normals[i][1];
+        int nz = z + face_normals[i][2];
+        BlockID neighbour;
+        bool neighbour_foreground;
+        if (nx >= 0 && ny >= 0 && nz >= 0 && nx < CHUNK_SIZE && ny < CHUNK_SIZE && nz < CHUNK_SIZE) {
+            neighbour            = chunk->get(nx, ny, nz);
+            neighbour_foreground = chunk->is_foreground(nx, ny, nz);
+        }
+        else {
+            int axis = face_axes[i];
+            unsigned char byte = source.border[i][axis == 0 ? ny : nx][axis == 2 ? ny : nz];
+            neighbour            = World::unpack_block(byte);
+            neighbour_foreground = byte & FOREGROUND_BIT;
+        }
+        // foreground and background are drawn (and exported) separately, so they can't hide each other
+        if (is_opaque_cube(neighbour) && neighbour_foreground == foreground) continue;
+        exposed |= 1 << i;
+    }
+    return exposed;
+}
+
+// merges neighbouring exposed cube faces with the same texture into bigger quads, the tile repeats across them in the shader
+// slices lists per face which slices along its normal have any exposed faces at all, the others are skipped
+int greedy_faces(const Chunk* chunk, const int* base, unsigned char exposed[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE], const unsigned int* slices) {
+    static const int axes[6][3] = { { 1, 0, 2 }, { 1, 0, 2 }, { 0, 1, 2 }, { 0, 1, 2 }, { 2, 0, 1 }, { 2, 0, 1 } }; // normal, plane a, plane b
+    int num_quads = 0;
+    unsigned char mask[CHUNK_SIZE][CHUNK_SIZE];
+    for (int face = 0; face < 6; face++) {
+        int n = axes[face][0], a = axes[face][1], b = axes[face][2];
+        bool positive = face % 2 == 0;
+        for (unsigned int remaining = slices[face]; remaining; remaining &= remaining - 1) {
+            int k = __builtin_ctz(remaining);
+            int cell[3];
+            cell[n] = k;
+            for (int j = 0; j < CHUNK_SIZE; j++) {
+                for (int i = 0; i < CHUNK_SIZE; i++) {
+                    cell[a] = i;
+                    cell[b] = j;
+                    bool visible = exposed[cell[0]][cell[1]][cell[2]] & (1 << face);
+                    mask[i][j] = visible ? chunk->get(cell[0], cell[1], cell[2]) : Block_Air;
+                }
+            }
+            for (int j = 0; j < CHUNK_SIZE; j++) {
+                for (int i = 0; i < CHUNK_SIZE; i++) {
+                    int block = mask[i][j];
+                    if (block == Block_Air) continue;
+                    const Texture& tex = block_info[block].faces[face];
+
+                    int w = 1, h = 1;
+                    while (i + w < CHUNK_SIZE && mask[i + w][j] != Block_Air && block_info[mask[i + w][j]].faces[face] == tex) w++;
+                    for (; j + h < CHUNK_SIZE; h++) {
+                        bool row = true;
+                        for (int d = 0; d < w && row; d++) row = mask[i + d][j + h] != Block_Air && block_info[mask[i + d][j + h]].faces[face] == tex;
+                        if (!row) break;
+                    }
+                    for (int dj = 0; dj < h; dj++) {
+                        for (int di = 0; di < w; di++) mask[i + di][j + dj] = Block_Air;
+                    }
+
+                    Vec2 from = Vec2(base[a] + i, base[b] + j);
+                    Vec2 to   = Vec2(base[a] + i + w, base[b] + j + h);
+                    float plane = base[n] + (positive ? k + 1 : k);
+                    face_repeat = Vec2(w, h);
+                    if      (n == 0) draw_xplane(from, to, plane, positive, tex);
+                    else if (n == 1) draw_yplane(from, to, plane, positive, tex);
+                    else             draw_zplane(from, to, plane, positive, tex);
+                    face_repeat = Vec2::one();
+                    num_quads++;
+                }
+            }
+        }
+    }
+    return num_quads;
+}
+
+// false when there's no chunk, nothing gets meshed for it then
+bool copy_chunk_source(const World& world, int cx, int cy, int cz, ChunkSource* source) {
+    const Chunk* chunk = world.chunk(cx, cy, cz);
+    if (!chunk) return false;
+    source->chunk = *chunk;
+    int c[3] = { cx, cy, cz };
+    IVec3 count = world.chunk_count();
+    int counts[3] = { count.x, count.y, count.z };
+    for (int i = 0; i < 3; i++) source->base[i] = c[i] * CHUNK_SIZE;
+
+    for (int face = 0; face < 6; face++) {
+        int axis = face_axes[face];
+        int n[3] = { c[0], c[1], c[2] };
+        n[axis] += face_normals[face][axis];
+        const Chunk* neighbour = n[axis] >= 0 && n[axis] < counts[axis] ? world.chunk(n[0], n[1], n[2]) : NULL;
+        if (!neighbour) {
+            memset(source->border[face], Block_Air, sizeof(source->border[face]));
+            continue;
+        }
+        // the neighbour's layer touching this chunk, u and v run over the other two axes
+        int cell[3];
+        cell[axis] = face_normals[face][axis] > 0 ? 0 : CHUNK_SIZE - 1;
+        int a = axis == 0 ? 1 : 0, b = axis == 2 ? 1 : 2;
+        for (int u = 0; u < CHUNK_SIZE; u++) {
+            for (int v = 0; v < CHUNK_SIZE; v++) {
+                cell[a] = u;
+                cell[b] = v;
+                BlockID block = neighbour->get(cell[0], cell[1], cell[2]);
+                source->border[face][u][v] = block | (neighbour->is_foreground(cell[0], cell[1], cell[2]) ? FOREGROUND_BIT : 0);
+            }
+        }
+    }
+    return true;
+}
+
+// meshes one context of a chunk into out, only the camera facing faces are emitted. safe to run on any thread
+int mesh_chunk(const ChunkSource& source, WorldContext context, int faces, std::vector<Vertex>* out, RenderStats* stats, bool* animated) {
+    static thread_local unsigned char exposed[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
+    static thread_local Bitplane cells;
+    const Chunk* chunk = &source.chunk;
+    const int* base = source.base;
+    out->clear();
+    animated_vertices = false;
+
+    chunk->partition(context, cells);
+    mesh_target = out;
+    int quads_culled = 0;
+    int cube_faces = 0;
+    unsigned int exposed_slices[6] = {};
+    memset(exposed, 0, sizeof(exposed));
+    // only the occupied cells of this context are visited, in the same x, y, z order as a full scan
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (unsigned int rows = chunk->occupied_rows(x); rows; rows &= rows - 1) {
+            int y = __builtin_ctz(rows);
+            for (unsigned int column = cells[x][y]; column; column &= column - 1) {
+                int z = __builtin_ctz(column);
+                BlockID block = chunk->get(x, y, z);
+                if (is_opaque_cube(block)) {
+                    // cubes are emitted by greedy_faces afterwards
+                    int cube = exposed_faces(source, faces, x, y, z);
+                    exposed[x][y][z] = cube;
+                    for (int face = 0; face < 6; face++) {
+                        if (cube & (1 << face)) exposed_slices[face] |= 1u << (face < 2 ? y : (face < 4 ? x : z));
+                    }
+                    int visible = __builtin_popcount(cube);
+                    quads_culled += 6 - visible;
+                    cube_faces += visible;
+                    continue;
+                }
+                visible_faces = faces;
+                draw_block(block, Vec3(base[0] + x, base[1] + y, base[2] + z));
+                visible_faces = Face_All;
+            }
+        }
+    }
+    int quads_merged = cube_faces - greedy_faces(chunk, base, exposed, exposed_slices);
+    mesh_target = NULL;
+
+    if (stats) {
+        stats->quads_emitted = out->size() / 4;
+        stats->quads_culled  = quads_culled;
+        stats->quads_merged  = quads_merged;
+    }
+    if (animated) *animated = animated_vertices;
+    return out->size();
+}
+
+void run_mesh_job(void* data) {
+    MeshJob* job = (MeshJob*)data;
+    mesh_chunk(job->source, job->context, job->faces, &job->vertices, &job->stats, &job->animated);
+    // tighter than the chunk when only part of it is filled, which is most of them on the surface
+    job->from = job->vertices.empty() ? Vec3::zero() : job->vertices[0].xyz;
+    job->to   = job->from;
+    for (const Vertex& vertex : job->vertices) {
+        job->from = Vec3(fminf(job->from.x, vertex.xyz.x), fminf(job->from.y, vertex.xyz.y), fminf(job->from.z, vertex.xyz.z));
+        job->to   = Vec3(fmaxf(job->to.x,   vertex.xyz.x), fmaxf(job->to.y,   vertex.xyz.y), fmaxf(job->to.z,   vertex.xyz.z));
+    }
+    job->state.store(MeshJob_Done, std::memory_order_release);
+}
+
+int mesh_voxels(World& world, WorldContext context, RenderStats* stats) {
+    // jobs of their own, so it doesn't get in the way of the meshes queued for drawing
+    static std::vector<MeshJob*> jobs;
+    JobGroup group;
+    IVec3 count = world.chunk_count();
+    size_t num_jobs = 0;
+    for (int cx = 0; cx < count.x; cx++) {
+        for (int cy = 0; cy < count.y; cy++) {
+            for (int cz = 0; cz < count.z; cz++) {
+                if (!world.chunk(cx, cy, cz)) continue;
+                if (num_jobs == jobs.size()) jobs.push_back(new MeshJob());
+                MeshJob* job = jobs[num_jobs++];
+                copy_chunk_source(world, cx, cy, cz, &job->source);
+                job->context = context;
+                job->faces   = camera_faces;
+                push_job(run_mesh_job, job, &group);
             }
         }
     }
+    wait_jobs(&group);
+
+    int num_vertices = 0;
+    if (stats) *stats = {};
+    for (size_t i = 0; i < num_jobs; i++) {
+        num_vertices += jobs[i]->vertices.size();
+        if (!stats) continue;
+        stats->quads_emitted += jobs[i]->stats.quads_emitted;
+        stats->quads_culled  += jobs[i]->stats.quads_culled;
+        stats->quads_merged  += jobs[i]->stats.quads_merged;
+    }
+    return num_vertices;
+}
+
+// job is NULL for a chunk without anything in it
+void set_chunk_mesh(ChunkMesh* mesh, const MeshJob* job) {
+    if (job && !job->vertices.empty()) {
+        if (mesh->vbo == 0) glGenBuffers(1, &mesh->vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+        glBufferData(GL_ARRAY_BUFFER, job->vertices.size() * sizeof(Vertex), job->vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    mesh->num_vertices = job ? job->vertices.size() : 0;
+    mesh->quads_culled = job ? job->stats.quads_culled : 0;
+    mesh->quads_merged = job ? job->stats.quads_merged : 0;
+    mesh->animated     = job && job->animated;
+    mesh->from         = job ? job->from : Vec3::zero();
+    mesh->to           = job ? job->to   : Vec3::zero();
+    mesh_version++;
+}
+
+// drops the chunk meshes when the world they were built for is gone or has a different number of chunks
+void reset_voxel_mesh(VoxelMesh* mesh, World& world) {
+    for (ChunkMesh& chunk : mesh->chunks) {
+        if (chunk.vbo) glDeleteBuffers(1, &chunk.vbo);
+    }
+    IVec3 count = world.chunk_count();
+    mesh->chunks.assign(count.x * count.y * count.z, ChunkMesh());
+    mesh->world       = &world;
+    mesh->chunk_count = count;
+    mesh->generation++;
+    mesh_version++;
+}
+
+// uploads what the job threads have finished, GL calls have to stay on this thread
+void collect_mesh_jobs() {
+    for (MeshJob& job : mesh_jobs) {
+        if (job.state.load(std::memory_order_acquire) != MeshJob_Done) continue;
+        VoxelMesh* mesh = &voxel_meshes[job.context];
+        ChunkMesh* chunk = job.generation == mesh->generation ? &mesh->chunks[job.index] : NULL;
+        // an older job can finish after a newer one for the same chunk, only the newest result is kept
+        if (chunk && job.ticket > chunk->ticket) {
+            set_chunk_mesh(chunk, &job);
+            chunk->version = job.version;
+            chunk->faces   = job.faces;
+            chunk->ticket  = job.ticket;
+        }
+        job.state.store(MeshJob_Free, std::memory_order_relaxed);
+    }
+}
+
+// queues every chunk whose mesh is out of date, the old mesh keeps getting drawn until the new one is collected
+void queue_mesh_jobs(World& world, WorldContext context) {
+    VoxelMesh* mesh = &voxel_meshes[context];
+    IVec3 count = world.chunk_count();
+    if (mesh->world != &world || !(mesh->chunk_count == count)) reset_voxel_mesh(mesh, world);
+
+    int free_job = 0;
+    int index = 0;
+    for (int cx = 0; cx < count.x; cx++) {
+        for (int cy = 0; cy < count.y; cy++) {
+            for (int cz = 0; cz < count.z; cz++, index++) {
+                ChunkMesh* chunk = &mesh->chunks[index];
+                unsigned int version = world.chunk_version(cx, cy, cz);
+                if (chunk->version == version && chunk->faces == camera_faces) continue;
+                if (chunk->queued_version == version && chunk->queued_faces == camera_faces) continue;
+
+                if (!world.chunk(cx, cy, cz)) {
+                    // nothing to mesh, no need to wait on a job
+                    set_chunk_mesh(chunk, NULL);
+                    chunk->version = chunk->queued_version = version;
+                    chunk->faces   = chunk->queued_faces   = camera_faces;
+                    chunk->ticket  = ++mesh_tickets;
+                    continue;
+                }
+                while (free_job < MESH_JOB_COUNT && mesh_jobs[free_job].state.load(std::memory_order_acquire) != MeshJob_Free) free_job++;
+                // the rest waits for a later frame
+                if (free_job == MESH_JOB_COUNT) return;
+
+                MeshJob* job = &mesh_jobs[free_job];
+                copy_chunk_source(world, cx, cy, cz, &job->source);
+                job->context    = context;
+                job->faces      = camera_faces;
+                job->generation = mesh->generation;
+                job->index      = index;
+                job->version    = version;
+                job->ticket     = ++mesh_tickets;
+                job->state.store(MeshJob_Queued, std::memory_order_relaxed);
+                chunk->queued_version = version;
+                chunk->queued_faces   = camera_faces;
+                push_job(run_mesh_job, job, &mesh_group);
+            }
+        }
+    }
+}
+
+void update_voxel_meshes(World& world) {
+    collect_mesh_jobs();
+    queue_mesh_jobs(world, BackgroundOnly);
+    queue_mesh_jobs(world, ForegroundOnly);
+}
+
+void finish_voxel_meshes(World& world) {
+    do {
+        update_voxel_meshes(world);
+        wait_jobs(&mesh_group);
+    } while (mesh_jobs_pending());
+}
+
+// true when the box is entirely on the outer side of one plane of the view volume, the near plane
+// is where main slices into the world so chunks in front of the cut are skipped as well
+bool outside_view(const Mtx& mvp, Vec3 from, Vec3 to) {
+    Vec4 corners[8];
+    for (int i = 0; i < 8; i++) corners[i] = Vec4(i & 1 ? to.x : from.x, i & 2 ? to.y : from.y, i & 4 ? to.z : from.z, 1);
+    mvp.transform(corners, corners, 8);
+    for (int axis = 0; axis < 3; axis++) {
+        bool below = true, above = true;
+        for (int i = 0; i < 8; i++) {
+            float v = axis == 0 ? corners[i].x : (axis == 1 ? corners[i].y : corners[i].z);
+            below = below && v < -corners[i].w;
+            above = above && v >  corners[i].w;
+        }
+        if (below || above) return true;
+    }
+    return false;
+}
+
+void draw_voxels(World& world, WorldContext context, int anim_frame) {
+    if (anim_frame == -1) anim_frame = current_anim_frame();
+
+    VoxelMesh* mesh = &voxel_meshes[context];
+    if (mesh->world != &world) return;
+    Mtx mvp = mtx_projection * matrices.back();
+
+    glEnable(GL_CULL_FACE);
+    glUseProgram(voxel_program);
+    glUniform1i(glGetUniformLocation(voxel_program, "tileset"), 0);
+    glUniform1f(glGetUniformLocation(voxel_program, "anim_frame"), anim_frame);
+    glActiveTexture(GL_TEXTURE0);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    for (ChunkMesh& chunk : mesh->chunks) {
+        if (chunk.num_vertices == 0 || outside_view(mvp, chunk.from, chunk.to)) continue;
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, xyz));
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, rect));
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, anim));
+        glDrawArrays(GL_QUADS, 0, chunk.num_vertices);
+    }
+    glDisableVertexAttribArray(3);
+    glDisableVertexAttribArray(2);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+    glDisable(GL_CULL_FACE);
+    glFlush();
+}
+
+GLuint create_layer_texture(GLint format, GLenum data_format, GLenum type, int width, int height) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, data_format, type, NULL);
+    return texture;
+}
+
+void resize_world_layer(WorldLayer* layer, int width, int height) {
+    if (layer->framebuffer) {
+        glDeleteFramebuffers(1, &layer->framebuffer);
+        glDeleteTextures(1, &layer->color);
+        glDeleteTextures(1, &layer->depth);
+    }
+    // the layer textures live on units 1 and 2 so the tileset can stay bound to unit 0
+    glActiveTexture(GL_TEXTURE1);
+    layer->color = create_layer_texture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+    glActiveTexture(GL_TEXTURE2);
+    layer->depth = create_layer_texture(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+    glActiveTexture(GL_TEXTURE0);
+
+    glGenFramebuffers(1, &layer->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, layer->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer->color, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_TEXTURE_2D, layer->depth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) printf("world layer framebuffer incomplete\n");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    layer->width  = width;
+    layer->height = height;
+    layer->valid  = false;
+}
+
+void draw_world(World& world, bool dim_background) {
+    WorldLayer* layer = &world_layer;
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (layer->width != viewport[2] || layer->height != viewport[3]) resize_world_layer(layer, viewport[2], viewport[3]);
+
+    update_voxel_meshes(world);
+    int anim_frame = current_anim_frame();
+    bool stale = !layer->valid
+        || layer->world           != &world
+        || layer->version         != world.version
+        || layer->mesh_version    != mesh_version
+        || layer->tileset_version != tileset_version
+        || (layer->anim_frame != anim_frame && voxels_animated())
+        || layer->dim_background  != dim_background
+        || layer->view_version    != view_version;
+
+    if (stale) {
+        glBindFramebuffer(GL_FRAMEBUFFER, layer->framebuffer);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        draw_grid(world);
+        dim_background ? glColor4f(.5f, .5f, .5f, 1.f) : glColor4f(1.f, 1.f, 1.f, 1.f);
+        draw_voxels(world, BackgroundOnly, anim_frame);
+        glColor4f(1.f, 1.f, 1.f, 1.f);
+        draw_voxels(world, ForegroundOnly, anim_frame);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        layer->valid           = true;
+        layer->world           = &world;
+        layer->version         = world.version;
+        layer->mesh_version    = mesh_version;
+        layer->tileset_version = tileset_version;
+        layer->anim_frame      = anim_frame;
+        layer->dim_background  = dim_background;
+        layer->view_version    = view_version;
+    }
+
+    // copy the cached color and depth into the window, so the selection still gets hidden behind blocks
+    glUseProgram(composite_program);
+    glUniform1i(glGetUniformLocation(composite_program, "color"), 1);
+    glUniform1i(glGetUniformLocation(composite_program, "depth"), 2);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, layer->color);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, layer->depth);
+    glActiveTexture(GL_TEXTURE0);
+    glDisable(GL_BLEND);
+    glDisable(GL_ALPHA_TEST);
+    glDepthFunc(GL_ALWAYS);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    render_begin();
+    glVertex2f(-1, -1);
+    glVertex2f( 1, -1);
+    glVertex2f( 1,  1);
+    glVertex2f(-1,  1);
     render_end();
-    glDisable(GL_TEXTURE_2D);
+    glDepthFunc(GL_LEQUAL);
+    glEnable(GL_ALPHA_TEST);
+    glEnable(GL_BLEND);
+    glUseProgram(0);
+    load_matrices();
+}
+
+RenderStats voxel_stats() {
+    RenderStats stats = {};
+    for (VoxelMesh& mesh : voxel_meshes) {
+        for (ChunkMesh& chunk : mesh.chunks) {
+            stats.quads_emitted += chunk.num_vertices / 4;
+            stats.quads_culled  += chunk.quads_culled;
+            stats.quads_merged  += chunk.quads_merged;
+        }
+    }
+    return stats;
 }
 
 void draw_selection(Selection* selection) {
-    float x = (sin(num_frames / 100.f * M_PI * 2) + 1) / 2 * 0.2f + 0.6f; // sine between 0.6 and 0.8
+    float x = (sin(SDL_GetTicks() / 1000.f * M_PI * 2) + 1) / 2 * 0.2f + 0.6f; // sine between 0.6 and 0.8, once a second
 
     push_matrix(Mtx::translate(selection->pos));
 
     glColor4f(1.f, 1.f, 1.f, 1.f);
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     render_begin();
-    if (selection->pos.y != -1) draw_cube();
-    else draw_yplane(Vec2::zero(), Vec2::one(), 1);
+    if (selection->pos.y != -1) draw_cube(Vec3::zero());
+    else draw_yplane(Vec2::zero(), Vec2::one(), 1, true);
     render_end();
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
     glColor4f(1.f, 1.f, 1.f, x);
     render_begin();
-    if      (selection->normal == IVec3::pos_x()) draw_xplane(Vec2::zero(), Vec2::one(), 1);
-    else if (selection->normal == IVec3::neg_x()) draw_xplane(Vec2::zero(), Vec2::one(), 0);
-    else if (selection->normal == IVec3::pos_y()) draw_yplane(Vec2::zero(), Vec2::one(), 1);
-    else if (selection->normal == IVec3::neg_y()) draw_yplane(Vec2::zero(), Vec2::one(), 0);
-    else if (selection->normal == IVec3::pos_z()) draw_zplane(Vec2::zero(), Vec2::one(), 1);
-    else if (selection->normal == IVec3::neg_z()) draw_zplane(Vec2::zero(), Vec2::one(), 0);
+    if      (selection->normal == IVec3::pos_x()) draw_xplane(Vec2::zero(), Vec2::one(), 1, true);
+    else if (selection->normal == IVec3::neg_x()) draw_xplane(Vec2::zero(), Vec2::one(), 0, false);
+    else if (selection->normal == IVec3::pos_y()) draw_yplane(Vec2::zero(), Vec2::one(), 1, true);
+    else if (selection->normal == IVec3::neg_y()) draw_yplane(Vec2::zero(), Vec2::one(), 0, false);
+    else if (selection->normal == IVec3::pos_z()) draw_zplane(Vec2::zero(), Vec2::one(), 1, true);
+    else if (selection->normal == IVec3::neg_z()) draw_zplane(Vec2::zero(), Vec2::one(), 0, false);
     else printf("invalid side: %d %d %d\n", selection->normal.x, selection->normal.y, selection->normal.z);
     render_end();
 
@@ -281,19 +979,23 @@ void draw_selection(Selection* selection) {
 BlockID draw_block_selection(float x, float y, float off_x, float off_y, BlockID prev) {
     glDisable(GL_DEPTH_TEST);
     glColor4f(0.f, 0.f, 0.f, .5f);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
     render_begin();
     glVertex2f(-1, -1);
     glVertex2f( 1, -1);
     glVertex2f( 1,  1);
     glVertex2f(-1,  1);
     render_end();
+    glMatrixMode(GL_MODELVIEW);
     glEnable(GL_DEPTH_TEST);
 
     glClear(GL_DEPTH_BUFFER_BIT);
     glColor4f(1.f, 1.f, 1.f, 1.f);
     glEnable(GL_TEXTURE_2D);
+    glEnable(GL_CULL_FACE);
     glActiveTexture(GL_TEXTURE0);
-    render_begin();
+    visible_faces = camera_faces;
 
     x -= 12;
     y += 24;
@@ -322,14 +1024,16 @@ BlockID draw_block_selection(float x, float y, float off_x, float off_y, BlockID
         unproject(nx, ny, &pos, &dir);
         pos += dir * 2;
 
-        push_matrix(Mtx::translate(pos));
-        draw_block(i);
-        pop_matrix();
+        load_matrices();
+        render_begin();
+        draw_block(i, pos);
+        render_end();
 
         angle += angle_step;
     }
 
-    render_end();
+    visible_faces = Face_All;
+    glDisable(GL_CULL_FACE);
     glDisable(GL_TEXTURE_2D);
 
     return select_block == Block_Air ? prev : (BlockID)select_block;
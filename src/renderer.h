@@ -2,23 +2,40 @@
 #define RENDERER_H
 
 #include "types.h"
+#include "world.h"
 
-#include <GL/gl.h>
+#include <GL/glew.h>
 
 extern Mtx mtx_projection;
 extern Mtx mtx_modelview;
 extern GLuint tileset_texture;
+extern unsigned int tileset_version;
+extern unsigned int view_version; // bumped whenever prepare_rendering ends up with a different camera or projection
 
 enum WorldContext {
     BackgroundOnly,
     ForegroundOnly,
 };
 
+struct RenderStats {
+    int quads_emitted;
+    int quads_culled;
+    int quads_merged;
+};
+
+void pan_camera(float right, float forward); // in world units along the ground
 void unproject(float x, float y, Vec3* pos, Vec3* dir);
-void prepare_rendering(float near_plane = .1f);
-void draw_grid();
-void draw_voxels(World world, WorldContext context, int anim_frame = -1);
+float view_depth(const World& world); // distance along the view to the farthest corner of the world
+void prepare_rendering(const World& world, float near_plane = .1f);
+void draw_grid(const World& world);
+int mesh_voxels(World& world, WorldContext context, RenderStats* stats = NULL); // meshes every chunk on the job threads and waits, without touching GL
+void update_voxel_meshes(World& world); // queues the out of date chunks on the job threads and uploads the finished ones
+void finish_voxel_meshes(World& world); // the same, but waits until every chunk is up to date
+void draw_voxels(World& world, WorldContext context, int anim_frame = -1);
+void draw_world(World& world, bool dim_background);
 void draw_selection(Selection* selection);
+RenderStats voxel_stats();
+int redraw_timeout(bool selection_visible);
 BlockID draw_block_selection(float x, float y, float off_x, float off_y, BlockID prev);
 
 #endif
\ No newline at end of file
@@ -1,18 +1,21 @@
 #include "selection.h"
 
-#include <GL/gl.h>
+#include <GL/glew.h>
 #include <SDL3/SDL.h>
 
 #include "renderer.h"
+#include "block_info.h"
 
 #include <stdbool.h>
 
-bool intersect_aabb(Vec3 origin, Vec3 dir, float* tmin_out, float* tmax_out) {
+bool intersect_aabb(Vec3 origin, Vec3 dir, Vec3 box_min, Vec3 box_max, float* tmin_out, float* tmax_out, int* axis_out) {
     float tmin = -INFINITY, tmax = INFINITY;
+    int axis = -1;
     for (int i = 0; i < 3; i++) {
         float o = i == 0 ? origin.x : (i == 1 ? origin.y : origin.z);
         float d = i == 0 ? dir.x    : (i == 1 ? dir   .y : dir   .z);
-        float min = 0.0f, max = 32.0f;
+        float min = i == 0 ? box_min.x : (i == 1 ? box_min.y : box_min.z);
+        float max = i == 0 ? box_max.x : (i == 1 ? box_max.y : box_max.z);
 
         if (fabsf(d) < 1e-6f) {
             if (o < min || o > max) return false;
@@ -25,7 +28,10 @@ bool intersect_aabb(Vec3 origin, Vec3 dir, float* tmin_out, float* tmax_out) {
                 t1 = t2;
                 t2 = tmp;
             }
-            if (tmin < t1) tmin = t1;
+            if (tmin < t1) {
+                tmin = t1;
+                axis = i;
+            }
             if (tmax > t2) tmax = t2;
             if (tmin > tmax) return false;
         }
@@ -33,98 +39,135 @@ bool intersect_aabb(Vec3 origin, Vec3 dir, float* tmin_out, float* tmax_out) {
 
     *tmin_out = tmin;
     *tmax_out = tmax;
+    *axis_out = axis;
     return true;
 }
 
-void cast(World world, Vec3 pos, Vec3 dir, Selection* selection) {
-    float t = 0.0;
-
-    int ix = floor(pos.x);
-    int iy = floor(pos.y);
-    int iz = floor(pos.z);
-
-    int stepx = (dir.x > 0) ? 1 : -1;
-    int stepy = (dir.y > 0) ? 1 : -1;
-    int stepz = (dir.z > 0) ? 1 : -1;
-
-    float tx_delta = fabsf(1 / dir.x);
-    float ty_delta = fabsf(1 / dir.y);
-    float tz_delta = fabsf(1 / dir.z);
+float boundary_distance(float origin, float dir, float boundary) {
+    return dir == 0 ? INFINITY : (boundary - origin) / dir;
+}
 
-    float xdist = (stepx > 0) ? (ix + 1 - pos.x) : (pos.x - ix);
-    float ydist = (stepy > 0) ? (iy + 1 - pos.y) : (pos.y - iy);
-    float zdist = (stepz > 0) ? (iz + 1 - pos.z) : (pos.z - iz);
+void cast(World& world, Vec3 pos, Vec3 dir, Selection* selection) {
+    // the layer below the world counts as solid, so there's something to place the first blocks on
+    IVec3 size = world.size();
+    float tmin, tmax;
+    int stepped_index;
+    if (!intersect_aabb(pos, dir, Vec3(0, -1, 0), Vec3(size.x, size.y, size.z), &tmin, &tmax, &stepped_index)) return;
+    if (tmin < 0) {
+        tmin = 0;
+        stepped_index = -1;
+    }
 
-    float tx_max = (tx_delta < INFINITY) ? tx_delta * xdist : INFINITY;
-    float ty_max = (ty_delta < INFINITY) ? ty_delta * ydist : INFINITY;
-    float tz_max = (tz_delta < INFINITY) ? tz_delta * zdist : INFINITY;
+    float origin[3] = { pos.x, pos.y, pos.z };
+    float delta [3] = { dir.x, dir.y, dir.z };
+    int lower[3] = { 0, -1, 0 };
+    int upper[3] = { size.x, size.y, size.z };
+    int cell[3], step[3];
+    float t_delta[3], t_max[3];
 
-    int stepped_index = -1;
+    for (int i = 0; i < 3; i++) {
+        step[i] = (delta[i] > 0) ? 1 : -1;
+        t_delta[i] = fabsf(1 / delta[i]);
+        cell[i] = floor(origin[i] + delta[i] * tmin);
+        if (cell[i] < lower[i]) cell[i] = lower[i];
+        if (cell[i] > upper[i] - 1) cell[i] = upper[i] - 1;
+        t_max[i] = boundary_distance(origin[i], delta[i], step[i] > 0 ? cell[i] + 1 : cell[i]);
+    }
 
-    while (t <= WORLD_SIZE * WORLD_SIZE * WORLD_SIZE) {
-        bool is_solid = false;
-        if (ix >= 0 && ix < WORLD_SIZE && iz >= 0 && iz < WORLD_SIZE) {
-            if (iy >= 0 && iy < WORLD_SIZE) is_solid = world[ix][iy][iz];
-            else if (iy == -1) is_solid = true;
+    while (true) {
+        for (int i = 0; i < 3; i++) {
+            if (cell[i] < lower[i] || cell[i] >= upper[i]) return;
         }
+
+        // the cell is in bounds here, so the chunk is looked up once for both the block and the empty extent
+        const Chunk* chunk = cell[1] == -1 ? NULL : world.chunk(cell[0] / CHUNK_SIZE, cell[1] / CHUNK_SIZE, cell[2] / CHUNK_SIZE);
+        int local[3] = { cell[0] % CHUNK_SIZE, cell[1] % CHUNK_SIZE, cell[2] % CHUNK_SIZE };
+        bool is_solid = cell[1] == -1 || (chunk && block_info[chunk->get(local[0], local[1], local[2])].flags & BlockFlag_Solid);
         if (is_solid) {
-            /*selection->pos = Vec3(
-                pos.x + t * dir.x,
-                pos.y + t * dir.y,
-                pos.z + t * dir.z
-            );*/
-            selection->pos = IVec3(ix, iy, iz);
-            if (stepped_index == 0) selection->normal = IVec3::pos_x() * -stepx;
-            if (stepped_index == 1) selection->normal = IVec3::pos_y() * -stepy;
-            if (stepped_index == 2) selection->normal = IVec3::pos_z() * -stepz;
+            selection->pos = IVec3(cell[0], cell[1], cell[2]);
+            if (stepped_index == 0) selection->normal = IVec3::pos_x() * -step[0];
+            if (stepped_index == 1) selection->normal = IVec3::pos_y() * -step[1];
+            if (stepped_index == 2) selection->normal = IVec3::pos_z() * -step[2];
             break;
         }
-        if (tx_max < ty_max) {
-            if (tx_max < tz_max) {
-                ix += stepx;
-                t = tx_max;
-                tx_max += tx_delta;
-                stepped_index = 0;
-            }
-            else {
-                iz += stepz;
-                t = tz_max;
-                tz_max += tz_delta;
-                stepped_index = 2;
-            }
-        }
-        else {
-            if (ty_max < tz_max) {
-                iy += stepy;
-                t = ty_max;
-                ty_max += ty_delta;
-                stepped_index = 1;
+
+        int extent = chunk ? chunk->empty_extent(local[0], local[1], local[2]) : CHUNK_SIZE;
+        if (extent > 1) {
+            // nothing in this brick, region or chunk, jump straight to where the ray leaves it
+            int base[3];
+            float t_exit = INFINITY;
+            for (int i = 0; i < 3; i++) {
+                base[i] = cell[i] / extent * extent;
+                float t = boundary_distance(origin[i], delta[i], step[i] > 0 ? base[i] + extent : base[i]);
+                if (t < t_exit) {
+                    t_exit = t;
+                    stepped_index = i;
+                }
             }
-            else {
-                iz += stepz;
-                t = tz_max;
-                tz_max += tz_delta;
-                stepped_index = 2;
+            for (int i = 0; i < 3; i++) {
+                if (i == stepped_index) cell[i] = step[i] > 0 ? base[i] + extent : base[i] - 1;
+                else {
+                    cell[i] = floor(origin[i] + delta[i] * t_exit);
+                    if (cell[i] < base[i]) cell[i] = base[i];
+                    if (cell[i] > base[i] + extent - 1) cell[i] = base[i] + extent - 1;
+                }
+                t_max[i] = boundary_distance(origin[i], delta[i], step[i] > 0 ? cell[i] + 1 : cell[i]);
             }
+            continue;
         }
+
+        int i = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+        cell[i] += step[i];
+        t_max[i] += t_delta[i];
+        stepped_index = i;
     }
-    return;
 }
 
-Selection* get_selection(World world, SDL_Window* window) {
+// the last pick, reused as long as none of the inputs of the cast changed
+struct PickCache {
+    bool valid = false;
+    float mouse_x, mouse_y;
+    int width, height;
+    unsigned int view_version;
+    const World* world;
+    unsigned int world_version;
+    Selection selection;
+};
+
+static PickCache pick_cache;
+
+Selection get_selection(World& world, SDL_Window* window) {
     int width, height;
     float mouse_x, mouse_y;
     SDL_GetMouseState(&mouse_x, &mouse_y);
     SDL_GetWindowSizeInPixels(window, &width, &height);
 
+    PickCache* cache = &pick_cache;
+    if (cache->valid
+        && cache->mouse_x == mouse_x && cache->mouse_y == mouse_y
+        && cache->width == width && cache->height == height
+        && cache->view_version == view_version
+        && cache->world == &world && cache->world_version == world.version
+    ) return cache->selection;
+
     float x = (2 * mouse_x) / width - 1;
     float y = 1 - (2 * mouse_y) / height;
 
     Vec3 pos, dir;
-    Selection* selection = (Selection*)malloc(sizeof(Selection));
-    selection->pos = IVec3(-1, -1, -1);
-    selection->normal = IVec3::pos_y();
+    Selection selection;
+    selection.pos = IVec3(-1, -1, -1);
+    selection.normal = IVec3::pos_y();
     unproject(x, y, &pos, &dir);
-    cast(world, pos, dir, selection);
+    cast(world, pos, dir, &selection);
+
+    cache->valid         = true;
+    cache->mouse_x       = mouse_x;
+    cache->mouse_y       = mouse_y;
+    cache->width         = width;
+    cache->height        = height;
+    cache->view_version  = view_version;
+    cache->world         = &world;
+    cache->world_version = world.version;
+    cache->selection     = selection;
     return selection;
 }
\ No newline at end of file
@@ -2,9 +2,11 @@
 #define SELECTION_H
 
 #include "types.h"
+#include "world.h"
 
 #include <SDL3/SDL.h>
 
-Selection* get_selection(World world, SDL_Window* window);
+void cast(World& world, Vec3 pos, Vec3 dir, Selection* selection);
+Selection get_selection(World& world, SDL_Window* window);
 
 #endif
\ No newline at end of file
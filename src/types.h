@@ -4,15 +4,25 @@
 #include "block.h"
 
 #include <math.h>
+#include <stddef.h>
 
-#define WORLD_SIZE 32
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define DEFAULT_WORLD_SIZE 32   // size of a new world along every axis, and of every .wrl file without a header
+#define MAX_WORLD_SIZE     1024
 #define TILEMAP_WIDTH  80
 #define TILEMAP_HEIGHT 64
 
 template<typename T> struct TVec2 {
     T x, y;
-    TVec2(): x(0), y(0) {}
-    TVec2(T x, T y): x(x), y(y) {}
+    constexpr TVec2(): x(0), y(0) {}
+    constexpr TVec2(T x, T y): x(x), y(y) {}
     TVec2 operator +(const TVec2& other) const {
         return TVec2(x + other.x, y + other.y);
     }
@@ -67,8 +77,8 @@ template<typename T> struct TVec2 {
 
 template<typename T> struct TVec3 {
     T x, y, z;
-    TVec3(): x(0), y(0), z(0) {}
-    TVec3(T x, T y, T z): x(x), y(y), z(z) {}
+    constexpr TVec3(): x(0), y(0), z(0) {}
+    constexpr TVec3(T x, T y, T z): x(x), y(y), z(z) {}
     TVec3 operator +(const TVec3& other) const {
         return TVec3(x + other.x, y + other.y, z + other.z);
     }
@@ -164,10 +174,10 @@ template<typename T> struct TVec3 {
 
 template<typename T> struct TVec4 {
     T x, y, z, w;
-    TVec4(): x(0), y(0), z(0), w(0) {}
-    TVec4(T x, T y, T z, T w): x(x), y(y), z(z), w(w) {}
-    TVec4(const TVec3<T>& vec, T w): x(vec.x), y(vec.y), z(vec.z), w(w) {}
-    TVec4(const TVec3<T>& vec):      x(vec.x), y(vec.y), z(vec.z), w(1) {}
+    constexpr TVec4(): x(0), y(0), z(0), w(0) {}
+    constexpr TVec4(T x, T y, T z, T w): x(x), y(y), z(z), w(w) {}
+    constexpr TVec4(const TVec3<T>& vec, T w): x(vec.x), y(vec.y), z(vec.z), w(w) {}
+    constexpr TVec4(const TVec3<T>& vec):      x(vec.x), y(vec.y), z(vec.z), w(1) {}
     TVec3<T> vec3() const {
         return TVec3<T>(x, y, z);
     }
@@ -184,23 +194,119 @@ typedef TVec3<int> IVec3;
 typedef TVec4<float> Vec4;
 typedef TVec4<int> IVec4;
 
+static_assert(sizeof(Vec4) == 4 * sizeof(float), "Vec4 must be four packed floats");
+
+// out[i] = m * in[i] for n column vectors, m is column-major, in and out may be the same array
+inline void mtx_transform(const float* m, const float* in, float* out, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    // two vectors per step, each 128 bit lane holds one of them
+    __m256 c0 = _mm256_broadcast_ps((const __m128*)(m + 0));
+    __m256 c1 = _mm256_broadcast_ps((const __m128*)(m + 4));
+    __m256 c2 = _mm256_broadcast_ps((const __m128*)(m + 8));
+    __m256 c3 = _mm256_broadcast_ps((const __m128*)(m + 12));
+    for (; i + 2 <= n; i += 2) {
+        __m256 v = _mm256_loadu_ps(in + i * 4);
+        __m256 r = _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(c2, _mm256_permute_ps(v, 0xAA)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xFF)));
+        _mm256_storeu_ps(out + i * 4, r);
+    }
+#endif
+#if defined(__SSE__)
+    __m128 s0 = _mm_loadu_ps(m + 0);
+    __m128 s1 = _mm_loadu_ps(m + 4);
+    __m128 s2 = _mm_loadu_ps(m + 8);
+    __m128 s3 = _mm_loadu_ps(m + 12);
+    for (; i < n; i++) {
+        __m128 v = _mm_loadu_ps(in + i * 4);
+        __m128 r = _mm_mul_ps(s0, _mm_shuffle_ps(v, v, 0x00));
+        r = _mm_add_ps(r, _mm_mul_ps(s1, _mm_shuffle_ps(v, v, 0x55)));
+        r = _mm_add_ps(r, _mm_mul_ps(s2, _mm_shuffle_ps(v, v, 0xAA)));
+        r = _mm_add_ps(r, _mm_mul_ps(s3, _mm_shuffle_ps(v, v, 0xFF)));
+        _mm_storeu_ps(out + i * 4, r);
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t s0 = vld1q_f32(m + 0);
+    float32x4_t s1 = vld1q_f32(m + 4);
+    float32x4_t s2 = vld1q_f32(m + 8);
+    float32x4_t s3 = vld1q_f32(m + 12);
+    for (; i < n; i++) {
+        float32x4_t v = vld1q_f32(in + i * 4);
+        float32x4_t r = vmulq_n_f32(s0, vgetq_lane_f32(v, 0));
+        r = vmlaq_n_f32(r, s1, vgetq_lane_f32(v, 1));
+        r = vmlaq_n_f32(r, s2, vgetq_lane_f32(v, 2));
+        r = vmlaq_n_f32(r, s3, vgetq_lane_f32(v, 3));
+        vst1q_f32(out + i * 4, r);
+    }
+#else
+    for (; i < n; i++) {
+        float x = in[i * 4 + 0], y = in[i * 4 + 1], z = in[i * 4 + 2], w = in[i * 4 + 3];
+        for (int r = 0; r < 4; r++) {
+            out[i * 4 + r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r] * w;
+        }
+    }
+#endif
+}
+
+// what a matrix is known to be, used to pick a cheaper inverse, a product keeps what both sides have in common
+enum MtxStructure {
+    Mtx_General  = 0,
+    Mtx_Affine   = 1 << 0, // bottom row is 0 0 0 1
+    Mtx_Rigid    = 1 << 1, // rotation and translation only
+    Mtx_Diagonal = 1 << 2, // scale and translation only, like orthographic projections
+};
+
 struct Mtx {
+    // reads like a float, writing to it means nothing is known about the matrix anymore
+    struct MtxCell {
+        operator float() const {
+            return *value;
+        }
+        MtxCell& operator=(float other) {
+            *value = other;
+            *kind = Mtx_General;
+            return *this;
+        }
+        MtxCell& operator=(const MtxCell& other) {
+            return *this = (float)other;
+        }
+        MtxCell& operator+=(float other) {
+            return *this = *value + other;
+        }
+        MtxCell& operator-=(float other) {
+            return *this = *value - other;
+        }
+        MtxCell& operator*=(float other) {
+            return *this = *value * other;
+        }
+        MtxCell& operator/=(float other) {
+            return *this = *value / other;
+        }
+        private: friend Mtx;
+            MtxCell(float* value, int* kind): value(value), kind(kind) {}
+            float* value;
+            int* kind;
+    };
     struct MtxRow {
-        float& operator[](int col) {
-            return data[col * 4 + row];
+        MtxCell operator[](int col) {
+            return MtxCell(&data[col * 4 + row], kind);
         }
         const float operator[](int col) const {
             return data[col * 4 + row];
         }
         private: friend Mtx;
-            MtxRow(float* data, int row): data(data), row(row) {}
+            MtxRow(float* data, int row, int* kind): data(data), row(row), kind(kind) {}
             float* data;
             int row;
+            int* kind;
     };
 
     static Mtx identity() {
         Mtx mtx = Mtx();
         mtx[0][0] = mtx[1][1] = mtx[2][2] = mtx[3][3] = 1;
+        mtx.kind = Mtx_Affine | Mtx_Rigid | Mtx_Diagonal;
         return mtx;
     }
     static Mtx scale(float x, float y, float z) {
@@ -208,6 +314,7 @@ struct Mtx {
         mtx[0][0] = x;
         mtx[1][1] = y;
         mtx[2][2] = z;
+        mtx.kind = Mtx_Affine | Mtx_Diagonal;
         return mtx;
     }
     static Mtx scale(float x) {
@@ -218,6 +325,7 @@ struct Mtx {
         mtx[0][3] = x;
         mtx[1][3] = y;
         mtx[2][3] = z;
+        mtx.kind = Mtx_Affine | Mtx_Rigid | Mtx_Diagonal;
         return mtx;
     }
     static Mtx quaternion(float x, float y, float z, float angle) {
@@ -254,6 +362,7 @@ struct Mtx {
         mtx[2][1] = (yz + wx);
         mtx[2][2] = 1.0f - (xx + yy);
 
+        mtx.kind = Mtx_Affine | Mtx_Rigid;
         return mtx;
     }
     static Mtx pitch(float angle) {
@@ -285,6 +394,7 @@ struct Mtx {
         mtx[0][3] = -(right + left) / (right - left);
         mtx[1][3] = -(top + bottom) / (top - bottom);
         mtx[2][3] = -(far + near) / (far - near);
+        mtx.kind = Mtx_Affine | Mtx_Diagonal;
         return mtx;
     }
     template<typename T> static Mtx scale(const TVec3<T>& vec) {
@@ -296,26 +406,21 @@ struct Mtx {
     template<typename T> static Mtx quaternion(const TVec3<T>& vec, float angle) {
         return quaternion(vec.x, vec.y, vec.z, angle);
     }
+    // column j of the product is this matrix applied to column j of the other
     Mtx operator *(const Mtx& other) const {
         Mtx mtx = Mtx();
-        mtx[0][0] = (*this)[0][0] * other[0][0] + (*this)[0][1] * other[1][0] + (*this)[0][2] * other[2][0] + (*this)[0][3] * other[3][0];
-        mtx[0][1] = (*this)[0][0] * other[0][1] + (*this)[0][1] * other[1][1] + (*this)[0][2] * other[2][1] + (*this)[0][3] * other[3][1];
-        mtx[0][2] = (*this)[0][0] * other[0][2] + (*this)[0][1] * other[1][2] + (*this)[0][2] * other[2][2] + (*this)[0][3] * other[3][2];
-        mtx[0][3] = (*this)[0][0] * other[0][3] + (*this)[0][1] * other[1][3] + (*this)[0][2] * other[2][3] + (*this)[0][3] * other[3][3];
-        mtx[1][0] = (*this)[1][0] * other[0][0] + (*this)[1][1] * other[1][0] + (*this)[1][2] * other[2][0] + (*this)[1][3] * other[3][0];
-        mtx[1][1] = (*this)[1][0] * other[0][1] + (*this)[1][1] * other[1][1] + (*this)[1][2] * other[2][1] + (*this)[1][3] * other[3][1];
-        mtx[1][2] = (*this)[1][0] * other[0][2] + (*this)[1][1] * other[1][2] + (*this)[1][2] * other[2][2] + (*this)[1][3] * other[3][2];
-        mtx[1][3] = (*this)[1][0] * other[0][3] + (*this)[1][1] * other[1][3] + (*this)[1][2] * other[2][3] + (*this)[1][3] * other[3][3];
-        mtx[2][0] = (*this)[2][0] * other[0][0] + (*this)[2][1] * other[1][0] + (*this)[2][2] * other[2][0] + (*this)[2][3] * other[3][0];
-        mtx[2][1] = (*this)[2][0] * other[0][1] + (*this)[2][1] * other[1][1] + (*this)[2][2] * other[2][1] + (*this)[2][3] * other[3][1];
-        mtx[2][2] = (*this)[2][0] * other[0][2] + (*this)[2][1] * other[1][2] + (*this)[2][2] * other[2][2] + (*this)[2][3] * other[3][2];
-        mtx[2][3] = (*this)[2][0] * other[0][3] + (*this)[2][1] * other[1][3] + (*this)[2][2] * other[2][3] + (*this)[2][3] * other[3][3];
-        mtx[3][0] = (*this)[3][0] * other[0][0] + (*this)[3][1] * other[1][0] + (*this)[3][2] * other[2][0] + (*this)[3][3] * other[3][0];
-        mtx[3][1] = (*this)[3][0] * other[0][1] + (*this)[3][1] * other[1][1] + (*this)[3][2] * other[2][1] + (*this)[3][3] * other[3][1];
-        mtx[3][2] = (*this)[3][0] * other[0][2] + (*this)[3][1] * other[1][2] + (*this)[3][2] * other[2][2] + (*this)[3][3] * other[3][2];
-        mtx[3][3] = (*this)[3][0] * other[0][3] + (*this)[3][1] * other[1][3] + (*this)[3][2] * other[2][3] + (*this)[3][3] * other[3][3];
+        mtx_transform(m, other.m, mtx.m, 4);
+        mtx.kind = kind & other.kind;
         return mtx;
     }
+    Vec4 operator *(const Vec4& other) const {
+        Vec4 vec;
+        mtx_transform(m, &other.x, &vec.x, 1);
+        return vec;
+    }
+    void transform(const Vec4* in, Vec4* out, size_t n) const {
+        mtx_transform(m, &in->x, &out->x, n);
+    }
     template<typename T> TVec4<T> operator *(const TVec4<T>& other) const {
         TVec4<T> vec = TVec4<T>();
         vec.x = other.x * (*this)[0][0] + other.y * (*this)[0][1] + other.z * (*this)[0][2] + other.w * (*this)[0][3];
@@ -328,14 +433,74 @@ struct Mtx {
         return *this * TVec4<T>(other.x, other.y, other.z, 1);
     }
     MtxRow operator[](int row) {
-        return MtxRow(m, row);
+        return MtxRow(m, row, &kind);
     }
     const MtxRow operator[](int row) const {
-        return MtxRow(const_cast<float*>(m), row);
+        return MtxRow(const_cast<float*>(m), row, NULL);
+    }
+    int structure() const {
+        return kind;
     }
     Mtx inv() const {
+        if (kind & Mtx_Rigid)    return inv_rigid();
+        if (kind & Mtx_Diagonal) return inv_diagonal();
+        if (kind & Mtx_Affine)   return inv_affine();
+        return inv_general();
+    }
+    // transposed rotation, translation rotated back
+    Mtx inv_rigid() const {
+        const Mtx& m = *this;
+        Mtx i = Mtx();
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) i[r][c] = m[c][r];
+        }
+        i[0][3] = -(i[0][0] * m[0][3] + i[0][1] * m[1][3] + i[0][2] * m[2][3]);
+        i[1][3] = -(i[1][0] * m[0][3] + i[1][1] * m[1][3] + i[1][2] * m[2][3]);
+        i[2][3] = -(i[2][0] * m[0][3] + i[2][1] * m[1][3] + i[2][2] * m[2][3]);
+        i[3][3] = 1;
+        i.kind = kind;
+        return i;
+    }
+    Mtx inv_diagonal() const {
+        const Mtx& m = *this;
+        if (m[0][0] == 0 || m[1][1] == 0 || m[2][2] == 0) return Mtx::identity();
+        Mtx i = Mtx();
+        for (int d = 0; d < 3; d++) {
+            i[d][d] = 1 / m[d][d];
+            i[d][3] = -m[d][3] * i[d][d];
+        }
+        i[3][3] = 1;
+        i.kind = kind;
+        return i;
+    }
+    // 3x3 inverse by cofactors, translation moved back through it
+    Mtx inv_affine() const {
+        const Mtx& m = *this;
+        Mtx i = Mtx();
+        i[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        i[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        i[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        float d = m[0][0] * i[0][0] + m[0][1] * i[1][0] + m[0][2] * i[2][0];
+        if (d == 0) return Mtx::identity();
+        i[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+        i[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+        i[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+        i[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+        i[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+        i[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) i[r][c] /= d;
+        }
+        i[0][3] = -(i[0][0] * m[0][3] + i[0][1] * m[1][3] + i[0][2] * m[2][3]);
+        i[1][3] = -(i[1][0] * m[0][3] + i[1][1] * m[1][3] + i[1][2] * m[2][3]);
+        i[2][3] = -(i[2][0] * m[0][3] + i[2][1] * m[1][3] + i[2][2] * m[2][3]);
+        i[3][3] = 1;
+        i.kind = Mtx_Affine;
+        return i;
+    }
+    Mtx inv_general() const {
+        const Mtx& m = *this;
         Mtx i = Mtx();
-        Mtx m = *this;
         i[0][0] =  m[1][1] * m[2][2] * m[3][3] - m[1][1] * m[2][3] * m[3][2] - m[2][1] * m[1][2] * m[3][3] + m[2][1] * m[1][3] * m[3][2] + m[3][1] * m[1][2] * m[2][3] - m[3][1] * m[1][3] * m[2][2];
         i[1][0] = -m[1][0] * m[2][2] * m[3][3] + m[1][0] * m[2][3] * m[3][2] + m[2][0] * m[1][2] * m[3][3] - m[2][0] * m[1][3] * m[3][2] - m[3][0] * m[1][2] * m[2][3] + m[3][0] * m[1][3] * m[2][2];
         i[2][0] =  m[1][0] * m[2][1] * m[3][3] - m[1][0] * m[2][3] * m[3][1] - m[2][0] * m[1][1] * m[3][3] + m[2][0] * m[1][3] * m[3][1] + m[3][0] * m[1][1] * m[2][3] - m[3][0] * m[1][3] * m[2][1];
@@ -362,6 +527,7 @@ struct Mtx {
     }
 private:
     float m[16] {};
+    int kind = Mtx_General;
     Mtx() {}
 };
 
@@ -375,6 +541,4 @@ struct Angle {
     constexpr static float deg = 180 / M_PI;
 };
 
-typedef unsigned char World[WORLD_SIZE][WORLD_SIZE][WORLD_SIZE];
-
 #endif
\ No newline at end of file
@@ -0,0 +1,402 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "types.h"
+
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// the world is stored in cubes of CHUNK_SIZE cells, chunks with nothing in them aren't allocated at all
+#define CHUNK_SIZE 32
+
+// the ray cast skips over empty bricks, regions and chunks, the number of non-air cells in each is kept here
+#define BRICK_SIZE  4
+#define REGION_SIZE 16
+
+// occupied cells and the foreground flag are also kept as one bit per cell along z, so a chunk column fits a word
+static_assert(CHUNK_SIZE <= 32, "occupancy columns are 32 bit words");
+
+// cells are stored as 4 bit block ids, two to a byte
+static_assert(Block_Count <= 16, "block ids have to fit in a nibble");
+static_assert(CHUNK_SIZE % 2 == 0, "rows are packed two cells to a byte");
+
+// a block byte in a .wrl file has this bit set when the cell is in the foreground
+#define FOREGROUND_BIT 0x80
+
+typedef unsigned int Bitplane[CHUNK_SIZE][CHUNK_SIZE];
+
+// coordinates are local to the chunk, 0 to CHUNK_SIZE - 1
+struct Chunk {
+    // cells that are occupied or in the foreground, the world drops the chunk once this is back to 0
+    int used = 0;
+
+    Chunk() {
+        memset(cells,      0, sizeof(cells));
+        memset(bricks,     0, sizeof(bricks));
+        memset(regions,    0, sizeof(regions));
+        memset(occupancy,  0, sizeof(occupancy));
+        memset(foreground, 0, sizeof(foreground));
+        memset(rows,       0, sizeof(rows));
+    }
+    BlockID get(int x, int y, int z) const {
+        return (BlockID)(cells[x][y][z / 2] >> (z % 2 * 4) & 0xF);
+    }
+    bool is_foreground(int x, int y, int z) const {
+        return foreground[x][y] >> z & 1;
+    }
+    // returns whether anything changed
+    bool set(int x, int y, int z, BlockID block, bool in_foreground) {
+        BlockID previous = get(x, y, z);
+        if (previous == block && is_foreground(x, y, z) == in_foreground) return false;
+        int diff = occupied(block) - occupied(previous);
+        bricks [x / BRICK_SIZE ][y / BRICK_SIZE ][z / BRICK_SIZE ] += diff;
+        regions[x / REGION_SIZE][y / REGION_SIZE][z / REGION_SIZE] += diff;
+        used -= __builtin_popcount(occupancy[x][y] | foreground[x][y]);
+        set_bit(occupancy,  x, y, z, occupied(block));
+        set_bit(foreground, x, y, z, in_foreground);
+        used += __builtin_popcount(occupancy[x][y] | foreground[x][y]);
+        update_row(x, y);
+        unsigned char& pair = cells[x][y][z / 2];
+        pair = z % 2 ? (pair & 0x0F) | block << 4 : (pair & 0xF0) | block;
+        return true;
+    }
+    // the CHUNK_SIZE cells along z at (x, y), unpacked to one id per byte
+    void get_row(int x, int y, BlockID* out) const {
+        for (int i = 0; i < CHUNK_SIZE / 2; i++) {
+            out[i * 2]     = (BlockID)(cells[x][y][i] & 0xF);
+            out[i * 2 + 1] = (BlockID)(cells[x][y][i] >> 4);
+        }
+    }
+    // bit z is set if the cell at (x, y, z) is in the foreground
+    unsigned int foreground_row(int x, int y) const {
+        return foreground[x][y];
+    }
+    bool set_row(int x, int y, const BlockID* blocks, unsigned int foreground_bits) {
+        unsigned char nibbles[CHUNK_SIZE / 2];
+        unsigned int occupied_bits = 0;
+        for (int i = 0; i < CHUNK_SIZE / 2; i++) nibbles[i] = (blocks[i * 2] & 0xF) | (blocks[i * 2 + 1] & 0xF) << 4;
+        for (int z = 0; z < CHUNK_SIZE; z++) occupied_bits |= (unsigned int)occupied(blocks[z] & 0xF) << z;
+        if (memcmp(nibbles, cells[x][y], sizeof(nibbles)) == 0 && foreground[x][y] == foreground_bits) return false;
+
+        for (int z = 0; z < CHUNK_SIZE; z += BRICK_SIZE) {
+            unsigned int brick = ((1u << BRICK_SIZE) - 1) << z;
+            int diff = __builtin_popcount(occupied_bits & brick) - __builtin_popcount(occupancy[x][y] & brick);
+            bricks [x / BRICK_SIZE ][y / BRICK_SIZE ][z / BRICK_SIZE ] += diff;
+            regions[x / REGION_SIZE][y / REGION_SIZE][z / REGION_SIZE] += diff;
+        }
+        used += __builtin_popcount(occupied_bits | foreground_bits) - __builtin_popcount(occupancy[x][y] | foreground[x][y]);
+        occupancy [x][y] = occupied_bits;
+        foreground[x][y] = foreground_bits;
+        update_row(x, y);
+        memcpy(cells[x][y], nibbles, sizeof(nibbles));
+        return true;
+    }
+    // bit y is set if column (x, y) has any non-air cell in it
+    unsigned int occupied_rows(int x) const {
+        return rows[x];
+    }
+    // the non-air cells of one layer, 0 for the background and 1 for the foreground like WorldContext
+    void partition(int layer, Bitplane out) const {
+        const unsigned int* occupied = &occupancy[0][0];
+        const unsigned int* flags    = &foreground[0][0];
+        unsigned int* result = &out[0][0];
+        const int words = CHUNK_SIZE * CHUNK_SIZE;
+        int i = 0;
+#if defined(__SSE2__)
+        __m128i flip = _mm_set1_epi32(layer ? 0 : -1);
+        for (; i + 4 <= words; i += 4) {
+            __m128i layer_bits = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(flags + i)), flip);
+            _mm_storeu_si128((__m128i*)(result + i), _mm_and_si128(_mm_loadu_si128((const __m128i*)(occupied + i)), layer_bits));
+        }
+#elif defined(__ARM_NEON)
+        uint32x4_t flip = vdupq_n_u32(layer ? 0 : ~0u);
+        for (; i + 4 <= words; i += 4) {
+            vst1q_u32(result + i, vandq_u32(vld1q_u32(occupied + i), veorq_u32(vld1q_u32(flags + i), flip)));
+        }
+#endif
+        unsigned int flip_bits = layer ? 0 : ~0u;
+        for (; i < words; i++) result[i] = occupied[i] & (flags[i] ^ flip_bits);
+    }
+    // size of the biggest aligned empty cube around the cell, 1 if its brick has something in it
+    int empty_extent(int x, int y, int z) const {
+        if (regions[x / REGION_SIZE][y / REGION_SIZE][z / REGION_SIZE] == 0) return REGION_SIZE;
+        if (bricks [x / BRICK_SIZE ][y / BRICK_SIZE ][z / BRICK_SIZE ] == 0) return BRICK_SIZE;
+        return 1;
+    }
+private:
+    static int occupied(unsigned char block) {
+        return block != Block_Air;
+    }
+    static void set_bit(Bitplane plane, int x, int y, int z, bool value) {
+        if (value) plane[x][y] |=   1u << z;
+        else       plane[x][y] &= ~(1u << z);
+    }
+    void update_row(int x, int y) {
+        if (occupancy[x][y]) rows[x] |=   1u << y;
+        else                 rows[x] &= ~(1u << y);
+    }
+
+    unsigned char cells[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE / 2];
+    unsigned char  bricks [CHUNK_SIZE / BRICK_SIZE ][CHUNK_SIZE / BRICK_SIZE ][CHUNK_SIZE / BRICK_SIZE ];
+    unsigned short regions[CHUNK_SIZE / REGION_SIZE][CHUNK_SIZE / REGION_SIZE][CHUNK_SIZE / REGION_SIZE];
+    Bitplane occupancy;
+    Bitplane foreground; // independent of the block so it round-trips for air cells too
+    unsigned int rows[CHUNK_SIZE];
+};
+
+// any size, chunks are looked up in a grid of pointers that stay NULL until something is placed in them
+struct World {
+    // read-only views so world[x][y][z] keeps working, cells outside the world read as air
+    struct Row {
+        const World* world;
+        int x, y;
+        BlockID operator[](int z) const {
+            return world->get(x, y, z);
+        }
+    };
+    struct Slice {
+        const World* world;
+        int x;
+        Row operator[](int y) const {
+            return Row { world, x, y };
+        }
+    };
+
+    // bumped on every change, caches compare against it to know when to rebuild
+    unsigned int version = 0;
+
+    World(int width = DEFAULT_WORLD_SIZE, int height = DEFAULT_WORLD_SIZE, int depth = DEFAULT_WORLD_SIZE) {
+        resize(width, height, depth);
+    }
+    ~World() {
+        release();
+    }
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    // out becomes a copy that shares every chunk with this world, whichever of the two changes a chunk first
+    // copies it. out can be read on another thread while this one keeps editing, but has to be released here
+    void snapshot(World& out) const {
+        out.version        = version;
+        out.dimensions     = dimensions;
+        out.chunk_counts   = chunk_counts;
+        out.chunks         = chunks;
+        out.chunk_versions = chunk_versions;
+    }
+
+    // empties the world
+    void resize(int width, int height, int depth) {
+        release();
+        dimensions = IVec3(width, height, depth);
+        chunk_counts = IVec3((width + CHUNK_SIZE - 1) / CHUNK_SIZE, (height + CHUNK_SIZE - 1) / CHUNK_SIZE, (depth + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        version++;
+        chunks.assign(chunk_counts.x * chunk_counts.y * chunk_counts.z, NULL);
+        chunk_versions.assign(chunks.size(), version);
+    }
+    void clear() {
+        resize(dimensions.x, dimensions.y, dimensions.z);
+    }
+    IVec3 size() const {
+        return dimensions;
+    }
+    IVec3 chunk_count() const {
+        return chunk_counts;
+    }
+    Slice operator[](int x) const {
+        return Slice { this, x };
+    }
+    bool in_bounds(int x, int y, int z) const {
+        return x >= 0 && y >= 0 && z >= 0 && x < dimensions.x && y < dimensions.y && z < dimensions.z;
+    }
+    BlockID get(int x, int y, int z) const {
+        if (!in_bounds(x, y, z)) return Block_Air;
+        const Chunk* chunk = chunks[chunk_index(x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)].get();
+        return chunk ? chunk->get(x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE) : Block_Air;
+    }
+    bool is_foreground(int x, int y, int z) const {
+        if (!in_bounds(x, y, z)) return false;
+        const Chunk* chunk = chunks[chunk_index(x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)].get();
+        return chunk && chunk->is_foreground(x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE);
+    }
+    void set(int x, int y, int z, BlockID block, bool in_foreground = false) {
+        if (!in_bounds(x, y, z)) return;
+        std::shared_ptr<Chunk>& chunk = chunks[chunk_index(x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)];
+        int lx = x % CHUNK_SIZE, ly = y % CHUNK_SIZE, lz = z % CHUNK_SIZE;
+        if (!chunk) {
+            if (block == Block_Air && !in_foreground) return;
+            chunk = std::make_shared<Chunk>();
+        }
+        else if (chunk->get(lx, ly, lz) == block && chunk->is_foreground(lx, ly, lz) == in_foreground) return;
+        if (!own(chunk)->set(lx, ly, lz, block, in_foreground)) return;
+        if (chunk->used == 0) chunk.reset();
+        touch(x, y, z);
+    }
+    void set_foreground(int x, int y, int z, bool in_foreground) {
+        set(x, y, z, get(x, y, z), in_foreground);
+    }
+    // the byte a .wrl file stores for the cell
+    unsigned char packed(int x, int y, int z) const {
+        return get(x, y, z) | (is_foreground(x, y, z) ? FOREGROUND_BIT : 0);
+    }
+    void set_packed(int x, int y, int z, unsigned char byte) {
+        set(x, y, z, unpack_block(byte), byte & FOREGROUND_BIT);
+    }
+    // unknown ids become air
+    static BlockID unpack_block(unsigned char byte) {
+        int block = byte & ~FOREGROUND_BIT;
+        return block < Block_Count ? (BlockID)block : Block_Air;
+    }
+    // the size().z cells along z at (x, y)
+    void get_row(int x, int y, BlockID* out) const {
+        BlockID row[CHUNK_SIZE];
+        for (int cz = 0; cz < chunk_counts.z; cz++) {
+            int z = cz * CHUNK_SIZE;
+            int n = dimensions.z - z < CHUNK_SIZE ? dimensions.z - z : CHUNK_SIZE;
+            const Chunk* chunk = chunks[chunk_index(x / CHUNK_SIZE, y / CHUNK_SIZE, cz)].get();
+            if (chunk) chunk->get_row(x % CHUNK_SIZE, y % CHUNK_SIZE, row);
+            else memset(row, Block_Air, sizeof(row));
+            memcpy(out + z, row, n * sizeof(BlockID));
+        }
+    }
+    void get_packed_row(int x, int y, unsigned char* out) const {
+        BlockID row[CHUNK_SIZE];
+        for (int cz = 0; cz < chunk_counts.z; cz++) {
+            int z = cz * CHUNK_SIZE;
+            int n = dimensions.z - z < CHUNK_SIZE ? dimensions.z - z : CHUNK_SIZE;
+            const Chunk* chunk = chunks[chunk_index(x / CHUNK_SIZE, y / CHUNK_SIZE, cz)].get();
+            if (!chunk) {
+                memset(out + z, Block_Air, n);
+                continue;
+            }
+            chunk->get_row(x % CHUNK_SIZE, y % CHUNK_SIZE, row);
+            unsigned int foreground = chunk->foreground_row(x % CHUNK_SIZE, y % CHUNK_SIZE);
+            for (int i = 0; i < n; i++) out[z + i] = row[i] | (foreground >> i & 1 ? FOREGROUND_BIT : 0);
+        }
+    }
+    void set_packed_row(int x, int y, const unsigned char* bytes) {
+        if (!in_bounds(x, y, 0)) return;
+        for (int cz = 0; cz < chunk_counts.z; cz++) set_packed_cells(x, y, cz, bytes + cz * CHUNK_SIZE);
+    }
+    // the CHUNK_SIZE^3 cells of a chunk in x, y, z order, cells outside the world read as air and are ignored when set
+    void get_packed_chunk(int cx, int cy, int cz, unsigned char* out) const {
+        const Chunk* chunk = chunks[chunk_index(cx, cy, cz)].get();
+        if (!chunk) {
+            memset(out, Block_Air, CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE);
+            return;
+        }
+        BlockID row[CHUNK_SIZE];
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            for (int y = 0; y < CHUNK_SIZE; y++, out += CHUNK_SIZE) {
+                chunk->get_row(x, y, row);
+                unsigned int foreground = chunk->foreground_row(x, y);
+                for (int z = 0; z < CHUNK_SIZE; z++) out[z] = row[z] | (foreground >> z & 1 ? FOREGROUND_BIT : 0);
+            }
+        }
+    }
+    void set_packed_chunk(int cx, int cy, int cz, const unsigned char* cells) {
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            for (int y = 0; y < CHUNK_SIZE; y++, cells += CHUNK_SIZE) {
+                if (in_bounds(cx * CHUNK_SIZE + x, cy * CHUNK_SIZE + y, cz * CHUNK_SIZE)) set_packed_cells(cx * CHUNK_SIZE + x, cy * CHUNK_SIZE + y, cz, cells);
+            }
+        }
+    }
+    // takes over a chunk filled somewhere else, cells of it outside the world have to be air. an empty one or NULL
+    // leaves the chunk empty
+    void set_chunk(int cx, int cy, int cz, std::shared_ptr<Chunk> chunk) {
+        if (chunk && chunk->used == 0) chunk.reset();
+        std::shared_ptr<Chunk>& slot = chunks[chunk_index(cx, cy, cz)];
+        if (!slot && !chunk) return;
+        slot = std::move(chunk);
+        version++;
+        int c[3]     = { cx, cy, cz };
+        int count[3] = { chunk_counts.x, chunk_counts.y, chunk_counts.z };
+        chunk_versions[chunk_index(cx, cy, cz)] = version;
+        for (int i = 0; i < 3; i++) {
+            for (int side = -1; side <= 1; side += 2) {
+                int n[3] = { c[0], c[1], c[2] };
+                n[i] += side;
+                if (n[i] >= 0 && n[i] < count[i]) chunk_versions[chunk_index(n[0], n[1], n[2])] = version;
+            }
+        }
+    }
+    // NULL when nothing was ever placed in it or everything got removed again
+    const Chunk* chunk(int cx, int cy, int cz) const {
+        return chunks[chunk_index(cx, cy, cz)].get();
+    }
+    // bumped whenever the chunk or a cell bordering it changes, so meshes of single chunks can be rebuilt
+    unsigned int chunk_version(int cx, int cy, int cz) const {
+        return chunk_versions[chunk_index(cx, cy, cz)];
+    }
+    // size of the biggest aligned empty cube around the cell, 1 if its brick has something in it
+    int empty_extent(int x, int y, int z) const {
+        const Chunk* chunk = chunks[chunk_index(x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)].get();
+        if (!chunk) return CHUNK_SIZE;
+        return chunk->empty_extent(x % CHUNK_SIZE, y % CHUNK_SIZE, z % CHUNK_SIZE);
+    }
+private:
+    int chunk_index(int cx, int cy, int cz) const {
+        return (cx * chunk_counts.y + cy) * chunk_counts.z + cz;
+    }
+    // the part of the row at (x, y) that lies in chunk cz, bytes starts at the chunk's first cell
+    void set_packed_cells(int x, int y, int cz, const unsigned char* bytes) {
+        int z = cz * CHUNK_SIZE;
+        int n = dimensions.z - z < CHUNK_SIZE ? dimensions.z - z : CHUNK_SIZE;
+        BlockID row[CHUNK_SIZE] = {};
+        unsigned int foreground = 0;
+        for (int i = 0; i < n; i++) {
+            row[i] = unpack_block(bytes[i]);
+            if (bytes[i] & FOREGROUND_BIT) foreground |= 1u << i;
+        }
+
+        std::shared_ptr<Chunk>& chunk = chunks[chunk_index(x / CHUNK_SIZE, y / CHUNK_SIZE, cz)];
+        if (!chunk) {
+            bool empty = foreground == 0;
+            for (int i = 0; i < n && empty; i++) empty = row[i] == Block_Air;
+            if (empty) return;
+            chunk = std::make_shared<Chunk>();
+        }
+        if (!own(chunk)->set_row(x % CHUNK_SIZE, y % CHUNK_SIZE, row, foreground)) return;
+        if (chunk->used == 0) chunk.reset();
+        touch(x, y, z);
+        touch(x, y, z + n - 1);
+    }
+    // the cell's chunk and the neighbours that see it across their border
+    void touch(int x, int y, int z) {
+        version++;
+        int cell[3]  = { x, y, z };
+        int count[3] = { chunk_counts.x, chunk_counts.y, chunk_counts.z };
+        int c[3] = { x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE };
+        chunk_versions[chunk_index(c[0], c[1], c[2])] = version;
+        for (int i = 0; i < 3; i++) {
+            int local = cell[i] % CHUNK_SIZE;
+            int neighbour = local == 0 ? c[i] - 1 : (local == CHUNK_SIZE - 1 ? c[i] + 1 : -1);
+            if (neighbour < 0 || neighbour >= count[i]) continue;
+            int n[3] = { c[0], c[1], c[2] };
+            n[i] = neighbour;
+            chunk_versions[chunk_index(n[0], n[1], n[2])] = version;
+        }
+    }
+    // a chunk shared with a snapshot is copied before it changes
+    static Chunk* own(std::shared_ptr<Chunk>& chunk) {
+        if (chunk.use_count() > 1) chunk = std::make_shared<Chunk>(*chunk);
+        return chunk.get();
+    }
+    void release() {
+        chunks.clear();
+    }
+
+    IVec3 dimensions;
+    IVec3 chunk_counts;
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    std::vector<unsigned int> chunk_versions;
+};
+
+#endif
\ No newline at end of file